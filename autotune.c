@@ -0,0 +1,168 @@
+#include "autotune.h"
+
+#include <errno.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+void read_cpu_model(char *model, size_t size) {
+    snprintf(model, size, "unknown");
+    FILE *file = fopen("/proc/cpuinfo", "r");
+    if (file == NULL) return;
+    char line[CPU_MODEL_MAX + 64];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) != 0 || colon == NULL) continue;
+        char *name = colon + 1 + strspn(colon + 1, " \t");
+        name[strcspn(name, "\n")] = '\0';
+        for (char *c = name; *c != '\0'; c++)
+            if (*c == '\t') *c = ' ';  // the tab separates the columns of the cache file
+        snprintf(model, size, "%s", name);
+        break;
+    }
+    fclose(file);
+}
+
+/* Returns the size class of the world: the cells rounded down to a power of 4, as exponent of 2. */
+static int size_class(int width, int height) {
+    long cells = (long)width * height;
+    int bits = 0;
+    while (cells >> (bits + 2) > 0) bits += 2;
+    return bits;
+}
+
+const char *autotune_cache_path() {
+    static char path[4096];
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (cache != NULL && cache[0] != '\0') snprintf(path, sizeof(path), "%s/gol/autotune.tsv", cache);
+    else if (home != NULL) snprintf(path, sizeof(path), "%s/.cache/gol/autotune.tsv", home);
+    else return NULL;
+    return path;
+}
+
+/* Creates the directories of path (without the file name), returns false on error. */
+static bool create_parent_dirs(const char *path) {
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *slash = strchr(dir + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) return false;
+        *slash = '/';
+    }
+    return true;
+}
+
+/*
+ * Looks up the last result of the cpu model, rule, size class and options in the cache file. Results with
+ * more threads than cores online are skipped, the cores may be limited on this start.
+ * @return true if a result was found.
+**/
+static bool read_cache(const char *path, const char *model, const char *rule, int size_bits,
+                       const TuneOptions *options, TuneResult *result) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return false;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    bool found = false;
+    char line[CPU_MODEL_MAX + 128];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *tab = strchr(line, '\t');
+        if (tab == NULL) continue;
+        *tab = '\0';
+        char line_rule[RULE_STRING_MAX];
+        int bits, fixed_threads, fixed_in_place, threads, in_place;
+        double speed;
+        if (strcmp(line, model) != 0
+            || sscanf(tab + 1, "%31s %d %d %d %d %d %lf", line_rule, &bits, &fixed_threads, &fixed_in_place,
+                      &threads, &in_place, &speed) != 7
+            || strcmp(line_rule, rule) != 0 || bits != size_bits || fixed_threads != options->num_threads
+            || fixed_in_place != options->in_place || threads < 1 || threads > cores) continue;
+        *result = (TuneResult){ .num_threads = threads, .in_place = in_place != 0,
+                                .generations_per_second = speed, .cached = true };
+        found = true;
+    }
+    fclose(file);
+    return found;
+}
+
+/* Appends the result to the cache file, returns false on error. */
+static bool write_cache(const char *path, const char *model, const char *rule, int size_bits,
+                        const TuneOptions *options, const TuneResult *result) {
+    if (!create_parent_dirs(path)) return false;
+    FILE *file = fopen(path, "a");
+    if (file == NULL) return false;
+    fprintf(file, "%s\t%s\t%d\t%d\t%d\t%d\t%d\t%.3f\n", model, rule, size_bits, options->num_threads, options->in_place,
+            result->num_threads, result->in_place, result->generations_per_second);
+    return fclose(file) == 0;
+}
+
+/*
+ * Steps a random world with the configuration for about seconds (after one step to warm up).
+ * @return the generations per second.
+**/
+static double benchmark(int width, int height, const Rule *rule, int num_threads, bool in_place, double seconds) {
+    GolWorld *world = gol_create(width, height, rule);
+    world->num_threads = num_threads;
+    world->in_place = in_place;
+    gol_fill_random(world, 0.5, 1);
+    gol_step(world, 1);
+    long steps = 0;
+    double start = omp_get_wtime(), elapsed;
+    do {
+        gol_step(world, 1);
+        steps++;
+        elapsed = omp_get_wtime() - start;
+    } while (elapsed < seconds || steps < 2);
+    gol_free(world);
+    return steps / elapsed;
+}
+
+bool autotune(int width, int height, const Rule *rule, const TuneOptions *options, TuneResult *result) {
+    char model[CPU_MODEL_MAX];
+    read_cpu_model(model, sizeof(model));
+    char rule_string[RULE_STRING_MAX];
+    format_rule(rule, rule_string, sizeof(rule_string));
+    int size_bits = size_class(width, height);
+    const char *path = autotune_cache_path();
+    if (path != NULL && read_cache(path, model, rule_string, size_bits, options, result)) {
+        log_info("Autotune: cached %d threads, %s for %s, 2^%d cells", result->num_threads,
+                 result->in_place ? "in place" : "double buffered", model, size_bits);
+        return true;
+    }
+
+    // Huge worlds are measured on a part of them, the speed per cell hardly changes beyond the caches
+    int bench_width = width < 4096 ? width : 4096;
+    int bench_height = (long)height * bench_width > AUTOTUNE_MAX_CELLS ? AUTOTUNE_MAX_CELLS / bench_width : height;
+
+    // The counts of threads are the powers of 2 below the cores and the cores, or the fixed count
+    int cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_counts[32], counts = 0;
+    if (options->num_threads > 0) thread_counts[counts++] = options->num_threads;
+    else {
+        for (int t = 1; t < cores && counts < 31; t *= 2) thread_counts[counts++] = t;
+        thread_counts[counts++] = cores > 0 ? cores : 1;
+    }
+    int first_in_place = options->in_place == 1 ? 1 : 0, last_in_place = options->in_place == 0 ? 0 : 1;
+    double seconds = AUTOTUNE_BUDGET / ((last_in_place - first_in_place + 1) * counts);
+
+    *result = (TuneResult){ 0 };
+    for (int c = 0; c < counts; c++) {
+        for (int in_place = first_in_place; in_place <= last_in_place; in_place++) {
+            double speed = benchmark(bench_width, bench_height, rule, thread_counts[c], in_place, seconds);
+            log_info("Autotune: %d threads, %s: %.1f generations/s", thread_counts[c],
+                     in_place ? "in place" : "double buffered", speed);
+            if (speed > result->generations_per_second)
+                *result = (TuneResult){ .num_threads = thread_counts[c], .in_place = in_place,
+                                        .generations_per_second = speed };
+        }
+    }
+    if (result->num_threads == 0) return false;
+    if (path == NULL || !write_cache(path, model, rule_string, size_bits, options, result))
+        log_warn("Autotune: cannot write the cache file %s", path != NULL ? path : "(no HOME)");
+    return true;
+}
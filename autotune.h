@@ -0,0 +1,54 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "gol.h"
+
+#define AUTOTUNE_BUDGET 2.0  // seconds of benchmarks when no cached result fits
+#define AUTOTUNE_MAX_CELLS (4096L * 4096)  // larger worlds are benchmarked with this many cells
+#define CPU_MODEL_MAX 256
+
+/*
+ * @struct TuneResult
+ * @brief The fastest configuration of the steps for one cpu model and size class.
+ * @param num_threads: the number of threads of the steps.
+ * @param in_place: true if the steps are faster in place.
+ * @param generations_per_second: the measured speed of this configuration.
+ * @param cached: true if the result was read from the cache file instead of measured.
+**/
+typedef struct {
+    int num_threads;
+    bool in_place;
+    double generations_per_second;
+    bool cached;
+} TuneResult;
+
+/*
+ * @struct TuneOptions
+ * @brief The dimensions autotune must not change, e.g. because the user set them.
+ * @param num_threads: the fixed number of threads, 0 to tune it.
+ * @param in_place: the fixed stepping, 1 in place, 0 double buffered (e.g. for sliced steps), -1 to tune it.
+**/
+typedef struct {
+    int num_threads;
+    int in_place;
+} TuneOptions;
+
+/*
+ * Finds the fastest count of threads and stepping (in place or double buffered) for a world of
+ * width x height cells with the rule, only the dimensions not fixed by options are tuned. The result is
+ * looked up in the cache file by the cpu model, the rule (it changes how many cells change and so the
+ * writes of a step), the size class (cells rounded down to a power of 4) and the options. Otherwise every
+ * configuration is benchmarked on a random world for a share of AUTOTUNE_BUDGET and the winner is
+ * appended to the cache file.
+ * @return false if no configuration could be measured.
+**/
+bool autotune(int width, int height, const Rule *rule, const TuneOptions *options, TuneResult *result);
+/* Writes the model name of the cpu (from /proc/cpuinfo, without tabs) to model, "unknown" if not found. */
+void read_cpu_model(char *model, size_t size);
+/* Returns the path of the cache file: $XDG_CACHE_HOME/gol/autotune.tsv or ~/.cache/gol/autotune.tsv. */
+const char *autotune_cache_path();
+
+#endif /* AUTOTUNE_H */
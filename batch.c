@@ -0,0 +1,327 @@
+/*
+ * gol_batch: runs a parameter sweep of headless simulations with libgol.
+ *
+ * Every line of the job file is one job: RULE DENSITY WxH GENERATIONS SEEDS
+ * SEEDS is a single seed, a list (1,5,9) or a range (1-100), every seed is a separate run.
+ * Empty lines and lines starting with '#' are skipped.
+ *
+ * The runs are spread over a pool of threads, a run only starts while the memory of all running
+ * worlds stays within the budget. One csv line with the statistics is written per finished run.
+ * With --no-cycles the final cycle is not searched, the generations are walked with gol_advance.
+**/
+#include <limits.h>
+#include <omp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gol.h"
+#include "logger.h"
+
+#define BATCH_LINE_MAX 512
+
+/*
+ * @struct BatchRun
+ * @brief One simulation of the sweep.
+ * @param job: the line number of the job in the job file.
+ * @param rule: the rule of the run.
+ * @param rule_string: the rule in B/S notation.
+ * @param density: the probability of a cell to be alive at the start.
+ * @param width: the width of the world.
+ * @param height: the height of the world.
+ * @param generations: the max count of generations.
+ * @param seed: the seed of the start cells.
+**/
+typedef struct {
+    int job;
+    Rule rule;
+    char rule_string[RULE_STRING_MAX];
+    double density;
+    int width;
+    int height;
+    long generations;
+    uint64_t seed;
+} BatchRun;
+
+/*
+ * @struct BatchResult
+ * @brief The statistics of one run.
+ * @param final_population: the population after the last generation.
+ * @param stabilisation: the first generation of the final cycle, -1 if none was found.
+ * @param period: the period of the final cycle (1 = still life), 0 if none was found.
+ * @param wall_time: the time of the run in seconds.
+**/
+typedef struct {
+    long final_population;
+    long stabilisation;
+    long period;
+    double wall_time;
+} BatchResult;
+
+/*
+ * @struct BatchQueue
+ * @brief The runs and the state shared by the worker threads.
+ * @param runs: all runs in the order of the job file.
+ * @param count: the count of runs.
+ * @param next: the index of the next run to start.
+ * @param memory_budget: the max bytes of all running worlds.
+ * @param memory_used: the bytes of the running worlds.
+ * @param running: the count of running runs.
+ * @param out: the csv output.
+ * @param mutex: protects all fields and the output.
+ * @param memory_freed: signaled when a run finished.
+ * @param find_cycles: true if the runs search the final cycle, false if they only advance to the last generation.
+**/
+typedef struct {
+    BatchRun *runs;
+    int count;
+    int next;
+    size_t memory_budget;
+    size_t memory_used;
+    int running;
+    FILE *out;
+    pthread_mutex_t mutex;
+    pthread_cond_t memory_freed;
+    bool find_cycles;
+} BatchQueue;
+
+/*
+ * Parses the seeds of a job: "7", "1,5,9" or "1-100".
+ * @return the count of seeds written to seeds (at most max), -1 if invalid.
+**/
+static long parse_seeds(const char *str, uint64_t *seeds, long max) {
+    unsigned long long first, last;
+    int len;
+    if (sscanf(str, "%llu-%llu%n", &first, &last, &len) == 2 && str[len] == '\0') {
+        if (last < first) return -1;
+        long count = 0;
+        for (unsigned long long s = first; s <= last && count < max; s++) seeds[count++] = s;
+        return count;
+    }
+    long count = 0;
+    const char *p = str;
+    while (*p != '\0' && count < max) {
+        char *end;
+        seeds[count++] = strtoull(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0')) return -1;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+/*
+ * Reads the job file and expands every job into one run per seed.
+ * @return the runs (count in *count), NULL on error.
+**/
+static BatchRun *read_jobs(const char *path, int *count) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open job file %s\n", path);
+        return NULL;
+    }
+    int capacity = 64;
+    BatchRun *runs = malloc(capacity * sizeof(BatchRun));
+    uint64_t *seeds = malloc(100000 * sizeof(uint64_t));
+    *count = 0;
+    char line[BATCH_LINE_MAX];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        char rule[64], size[64], seed_list[256];
+        BatchRun run = { .job = line_number };
+        char *start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\0') continue;
+        if (sscanf(start, "%63s %lf %63s %ld %255s", rule, &run.density, size, &run.generations, seed_list) != 5
+            || !parse_rule(rule, &run.rule) || sscanf(size, "%dx%d", &run.width, &run.height) != 2
+            || run.width < 1 || run.height < 1 || run.generations < 0 || run.density < 0 || run.density > 1) {
+            fprintf(stderr, "%s:%d: invalid job, expected RULE DENSITY WxH GENERATIONS SEEDS\n", path, line_number);
+            goto error;
+        }
+        long seed_count = parse_seeds(seed_list, seeds, 100000);
+        if (seed_count <= 0) {
+            fprintf(stderr, "%s:%d: invalid seeds %s\n", path, line_number, seed_list);
+            goto error;
+        }
+        format_rule(&run.rule, run.rule_string, sizeof(run.rule_string));
+        for (long s = 0; s < seed_count; s++) {
+            if (*count == capacity) {
+                capacity *= 2;
+                runs = realloc(runs, capacity * sizeof(BatchRun));
+            }
+            run.seed = seeds[s];
+            runs[(*count)++] = run;
+        }
+    }
+    free(seeds);
+    fclose(file);
+    return runs;
+
+error:
+    free(seeds);
+    free(runs);
+    fclose(file);
+    return NULL;
+}
+
+/*
+ * Runs one simulation without the search for the final cycle: all generations are calculated with
+ * gol_advance, which keeps few rows in the cache for many generations.
+**/
+static BatchResult advance_simulation(const BatchRun *run) {
+    BatchResult result = { .stabilisation = -1 };
+    double start = omp_get_wtime();
+    GolWorld *world = gol_create(run->width, run->height, &run->rule);
+    gol_fill_random(world, run->density, run->seed);
+    for (long left = run->generations; left > 0; left -= INT_MAX)
+        gol_advance(world, left < INT_MAX ? left : INT_MAX);
+    result.final_population = world->population;
+    gol_free(world);
+    result.wall_time = omp_get_wtime() - start;
+    return result;
+}
+
+/*
+ * Runs one simulation. The hash of every generation is kept in an open addressing table,
+ * the first repeated hash ends the run: the cycle is known and the final population follows from it.
+**/
+static BatchResult run_simulation(const BatchRun *run) {
+    BatchResult result = { .stabilisation = -1 };
+    double start = omp_get_wtime();
+    GolWorld *world = gol_create(run->width, run->height, &run->rule);
+    world->in_place = true;  // no snapshots, the second buffer is not needed
+    gol_fill_random(world, run->density, run->seed);
+
+    long table_size = 1;
+    while (table_size < 2 * (run->generations + 1)) table_size *= 2;
+    uint64_t *hashes = malloc(table_size * sizeof(uint64_t));
+    long *table_generations = malloc(table_size * sizeof(long));
+    memset(table_generations, -1, table_size * sizeof(long));
+    long *populations = malloc((run->generations + 1) * sizeof(long));
+
+    for (long generation = 0;; generation++) {
+        populations[generation] = world->population;
+        uint64_t hash = gol_hash(world);  // kept up to date by the steps, no pass over the cells
+        long slot = hash & (table_size - 1);
+        while (table_generations[slot] >= 0 && hashes[slot] != hash) slot = (slot + 1) & (table_size - 1);
+        if (table_generations[slot] >= 0) {
+            result.stabilisation = table_generations[slot];
+            result.period = generation - result.stabilisation;
+            long offset = (run->generations - result.stabilisation) % result.period;
+            result.final_population = populations[result.stabilisation + offset];
+            break;
+        }
+        hashes[slot] = hash;
+        table_generations[slot] = generation;
+        if (generation == run->generations) {
+            result.final_population = world->population;
+            break;
+        }
+        gol_step(world, 1);
+    }
+    free(populations);
+    free(table_generations);
+    free(hashes);
+    gol_free(world);
+    result.wall_time = omp_get_wtime() - start;
+    return result;
+}
+
+static void *batch_worker(void *arg) {
+    BatchQueue *queue = arg;
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->next < queue->count) {
+        BatchRun *run = &queue->runs[queue->next];
+        size_t memory = queue->find_cycles ? gol_memory_size(run->width, run->height, true, false) + (run->generations + 1) * 72  // + hashes and populations
+                                           : gol_memory_size(run->width, run->height, false, false);
+        // A run larger than the budget is started when nothing else runs
+        if (queue->memory_used + memory > queue->memory_budget && queue->running > 0) {
+            pthread_cond_wait(&queue->memory_freed, &queue->mutex);
+            continue;
+        }
+        if (memory > queue->memory_budget)
+            log_warn("Job %d (%dx%d) needs %zu bytes, more than the memory budget.", run->job, run->width, run->height, memory);
+        queue->next++;
+        queue->memory_used += memory;
+        queue->running++;
+        pthread_mutex_unlock(&queue->mutex);
+
+        BatchResult result = queue->find_cycles ? run_simulation(run) : advance_simulation(run);
+
+        pthread_mutex_lock(&queue->mutex);
+        fprintf(queue->out, "%d,%s,%g,%d,%d,%ld,%llu,%ld,%ld,%ld,%.6f\n", run->job, run->rule_string, run->density,
+                run->width, run->height, run->generations, (unsigned long long)run->seed, result.final_population,
+                result.stabilisation, result.period, result.wall_time);
+        fflush(queue->out);
+        queue->memory_used -= memory;
+        queue->running--;
+        pthread_cond_broadcast(&queue->memory_freed);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return NULL;
+}
+
+static void print_usage(const char *name) {
+    printf("Usage: %s JOBFILE [--jobs N] [--memory MB] [--output FILE] [--no-cycles]\n", name);
+    printf("  JOBFILE     : One job per line: RULE DENSITY WxH GENERATIONS SEEDS (e.g. B3/S23 0.3 256x256 5000 1-20)\n");
+    printf("  --jobs N    : Runs at the same time, default the count of cores\n");
+    printf("  --memory MB : Memory budget of all running worlds, default 1024\n");
+    printf("  --output F  : Write the csv to F instead of stdout\n");
+    printf("  --no-cycles : Do not search the final cycle (stabilisation -1, period 0), walk the generations\n");
+    printf("                in cache sized space time trapezoids instead\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *job_path = NULL, *output_path = NULL;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    double memory_mb = 1024;
+    bool find_cycles = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) memory_mb = atof(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) output_path = argv[++i];
+        else if (strcmp(argv[i], "--no-cycles") == 0) find_cycles = false;
+        else if (strcmp(argv[i], "-h") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        else if (argv[i][0] != '-' && job_path == NULL) job_path = argv[i];
+        else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (job_path == NULL || workers < 1 || memory_mb <= 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    BatchQueue queue = { .memory_budget = memory_mb * 1024 * 1024, .out = stdout, .find_cycles = find_cycles };
+    queue.runs = read_jobs(job_path, &queue.count);
+    if (queue.runs == NULL) return EXIT_FAILURE;
+    if (output_path != NULL && (queue.out = fopen(output_path, "w")) == NULL) {
+        fprintf(stderr, "Cannot open output file %s\n", output_path);
+        free(queue.runs);
+        return EXIT_FAILURE;
+    }
+    log_info("Batch %s: %d runs on %d threads, memory budget %.0f MB", job_path, queue.count, workers, memory_mb);
+
+    fprintf(queue.out, "job,rule,density,width,height,generations,seed,final_population,stabilisation_generation,period,wall_time\n");
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_cond_init(&queue.memory_freed, NULL);
+    pthread_t *threads = malloc(workers * sizeof(pthread_t));
+    for (int i = 0; i < workers; i++)
+        pthread_create(&threads[i], NULL, batch_worker, &queue);
+    for (int i = 0; i < workers; i++)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&queue.mutex);
+    pthread_cond_destroy(&queue.memory_freed);
+
+    free(threads);
+    free(queue.runs);
+    if (queue.out != stdout) fclose(queue.out);
+    return EXIT_SUCCESS;
+}
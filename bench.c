@@ -0,0 +1,457 @@
+/*
+ * gol_bench: measures how the steps of libgol scale with the count of threads and the size of the grid.
+ *
+ * Every engine (gol_step double buffered, gol_step in place, gol_advance) runs on random square
+ * worlds from a few KB (L1) to beyond the last level cache, with every count of threads from 1 to
+ * the count of cores. One line of the table is written per measurement: the generations and cells per
+ * second, the speedup and the parallel efficiency against 1 thread and the memory bandwidth the step
+ * would need if every generation passed over all planes of the world.
+ *
+ * With --repeats every measurement is repeated, the table shows the median. --save writes the results
+ * with the commit and the machine as json, --compare measures the cases of such a baseline again and
+ * compares them: a case is a regression if it is slower by more than the threshold and the confidence
+ * intervals of both medians do not overlap. The exit code is 1 if there is a regression or a case of
+ * the baseline cannot be measured.
+**/
+#include <math.h>
+#include <omp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "autotune.h"
+#include "gol.h"
+#include "logger.h"
+
+#define BENCH_SIZES_MAX 32
+#define BENCH_REPEATS_MAX 100
+#define BENCH_ID_MAX 512  // max length of the commit and the machine
+#define BENCH_LINE_MAX 1024
+#define ADVANCE_GENERATIONS 32  // generations per call of gol_advance
+// Bytes per cell and generation of a pass over the world: read and write the cell, write its change bit.
+// The births are only written on births and not counted, the heat is not enabled.
+#define BYTES_PER_CELL (2 * sizeof(uint8_t) + 1.0 / 8)
+
+typedef enum {
+    ENGINE_DOUBLE_BUFFERED,
+    ENGINE_IN_PLACE,
+    ENGINE_ADVANCE,
+    ENGINE_COUNT
+} Engine;
+
+static const char *ENGINE_NAMES[ENGINE_COUNT] = { "double", "in-place", "advance" };
+
+/*
+ * @struct BenchResult
+ * @brief One measurement of the sweep.
+ * @param engine: the stepping of the measurement.
+ * @param size: the width and height of the world.
+ * @param threads: the count of threads.
+ * @param generations_per_second: the median speed of the runs.
+ * @param ci_low: the lower bound of the 95% confidence interval of the median.
+ * @param ci_high: the upper bound of the 95% confidence interval of the median.
+ * @param runs: the count of runs.
+**/
+typedef struct {
+    Engine engine;
+    int size;
+    int threads;
+    double generations_per_second;
+    double ci_low;
+    double ci_high;
+    int runs;
+} BenchResult;
+
+/*
+ * @struct Baseline
+ * @brief The results of a benchmark run, as saved with --save.
+ * @param commit: the commit the results were measured with.
+ * @param machine: the host name and cpu model.
+ * @param results: the measurements.
+ * @param count: the count of measurements.
+ * @param unmeasurable: the count of cases of the file that cannot be measured (unknown engine, invalid size).
+**/
+typedef struct {
+    char commit[BENCH_ID_MAX];
+    char machine[BENCH_ID_MAX];
+    BenchResult *results;
+    int count;
+    int unmeasurable;
+} Baseline;
+
+/*
+ * Steps a random world of size x size cells with the engine for about seconds (after a warm up).
+ * @return the generations per second.
+**/
+static double measure(Engine engine, int size, int threads, double seconds) {
+    Rule rule = default_rule();
+    GolWorld *world = gol_create(size, size, &rule);
+    world->num_threads = threads;
+    world->in_place = engine == ENGINE_IN_PLACE;
+    gol_fill_random(world, 0.5, 1);
+    int generations = engine == ENGINE_ADVANCE ? ADVANCE_GENERATIONS : 1;
+    if (engine == ENGINE_ADVANCE) gol_advance(world, generations);
+    else gol_step(world, generations);
+    long steps = 0;
+    double start = omp_get_wtime(), elapsed;
+    do {
+        if (engine == ENGINE_ADVANCE) gol_advance(world, generations);
+        else gol_step(world, generations);
+        steps += generations;
+        elapsed = omp_get_wtime() - start;
+    } while (elapsed < seconds || steps < 2);
+    gol_free(world);
+    return steps / elapsed;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sets the median of the runs and its 95% confidence interval from the order statistics: the ranks
+ * n/2 -+ 0.98 * sqrt(n) (binomial distribution of the count of runs below the true median).
+ * With 7 runs or less the interval is the min and the max. Sorts the speeds.
+**/
+static void summarize_runs(double *speeds, int runs, BenchResult *result) {
+    qsort(speeds, runs, sizeof(double), compare_doubles);
+    result->runs = runs;
+    result->generations_per_second = runs % 2 == 1 ? speeds[runs / 2] : (speeds[runs / 2 - 1] + speeds[runs / 2]) / 2;
+    int k = (int)((runs - 1.96 * sqrt(runs)) / 2);
+    if (k < 0) k = 0;
+    result->ci_low = speeds[k];
+    result->ci_high = speeds[runs - 1 - k];
+}
+
+/* Writes the commit of the working directory (git, with -dirty for changes) to commit, "unknown" without git. */
+static void read_commit(char *commit, size_t size) {
+    snprintf(commit, size, "unknown");
+    FILE *git = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+    if (git == NULL) return;
+    char line[BENCH_ID_MAX] = "";
+    bool found = fgets(line, sizeof(line), git) != NULL;
+    pclose(git);
+    line[strcspn(line, "\n")] = '\0';
+    if (!found || line[0] == '\0') return;
+    git = popen("git status --porcelain --untracked-files=no 2>/dev/null", "r");
+    bool dirty = git != NULL && fgetc(git) != EOF;
+    if (git != NULL) pclose(git);
+    snprintf(commit, size, "%s%s", line, dirty ? "-dirty" : "");
+}
+
+/* Writes the host name and the cpu model to machine. */
+static void read_machine(char *machine, size_t size) {
+    char host[256] = "unknown", model[CPU_MODEL_MAX];
+    gethostname(host, sizeof(host) - 1);
+    read_cpu_model(model, sizeof(model));
+    snprintf(machine, size, "%s / %s", host, model);
+}
+
+/* Writes str as json string, quotes and backslashes are escaped. */
+static void write_json_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (const char *c = str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', file);
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/*
+ * Writes the results as json to the file at path, one result per line (see read_baseline).
+ * @return false if the file could not be written.
+**/
+static bool save_baseline(const char *path, const Baseline *baseline) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        log_error("Cannot write the benchmark results to %s", path);
+        return false;
+    }
+    char date[32];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    fprintf(file, "{\n  \"commit\": ");
+    write_json_string(file, baseline->commit);
+    fprintf(file, ",\n  \"machine\": ");
+    write_json_string(file, baseline->machine);
+    fprintf(file, ",\n  \"date\": \"%s\",\n  \"results\": [\n", date);
+    for (int r = 0; r < baseline->count; r++) {
+        const BenchResult *result = &baseline->results[r];
+        fprintf(file, "    {\"engine\": \"%s\", \"size\": %d, \"threads\": %d, \"generations_per_second\": %.6g, "
+                "\"ci_low\": %.6g, \"ci_high\": %.6g, \"runs\": %d}%s\n", ENGINE_NAMES[result->engine], result->size,
+                result->threads, result->generations_per_second, result->ci_low, result->ci_high, result->runs,
+                r + 1 < baseline->count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+/*
+ * Reads a baseline written by save_baseline. Only this layout is read (one result per line),
+ * not any json. Results that cannot be measured again are written to stdout and counted in
+ * baseline->unmeasurable. Free baseline->results afterwards.
+ * @return false if the file could not be read or has no results.
+**/
+static bool read_baseline(const char *path, Baseline *baseline) {
+    *baseline = (Baseline){ .commit = "unknown", .machine = "unknown" };
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        log_error("Cannot read the baseline %s", path);
+        return false;
+    }
+    int capacity = 64;
+    baseline->results = malloc(capacity * sizeof(BenchResult));
+    char line[BENCH_LINE_MAX], engine[16];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        BenchResult result;
+        if (sscanf(line, " \"commit\": \"%511[^\"]\"", baseline->commit) == 1) continue;
+        if (sscanf(line, " \"machine\": \"%511[^\"]\"", baseline->machine) == 1) continue;
+        if (strstr(line, "\"engine\"") == NULL) continue;
+        int e = 0;
+        if (sscanf(line, " {\"engine\": \"%15[^\"]\", \"size\": %d, \"threads\": %d, \"generations_per_second\": %lf, "
+                   "\"ci_low\": %lf, \"ci_high\": %lf, \"runs\": %d", engine, &result.size, &result.threads,
+                   &result.generations_per_second, &result.ci_low, &result.ci_high, &result.runs) == 7) {
+            while (e < ENGINE_COUNT && strcmp(engine, ENGINE_NAMES[e]) != 0) e++;
+        }
+        else e = ENGINE_COUNT;
+        if (e == ENGINE_COUNT || result.size < 1 || result.threads < 1 || result.generations_per_second <= 0) {
+            printf("Cannot measure the baseline case %s", line + strspn(line, " "));
+            baseline->unmeasurable++;
+            continue;
+        }
+        result.engine = e;
+        if (baseline->count == capacity) {
+            capacity *= 2;
+            baseline->results = realloc(baseline->results, capacity * sizeof(BenchResult));
+        }
+        baseline->results[baseline->count++] = result;
+    }
+    fclose(file);
+    if (baseline->count == 0 && baseline->unmeasurable == 0) {
+        log_error("No results in the baseline %s", path);
+        free(baseline->results);
+        return false;
+    }
+    return true;
+}
+
+/* Returns the result of the baseline with the engine, size and threads of result, NULL if none. */
+static const BenchResult *find_result(const Baseline *baseline, const BenchResult *result) {
+    for (int r = 0; r < baseline->count; r++) {
+        const BenchResult *other = &baseline->results[r];
+        if (other->engine == result->engine && other->size == result->size && other->threads == result->threads)
+            return other;
+    }
+    return NULL;
+}
+
+/*
+ * Writes the comparison of every result with the baseline, the results are the cases of the baseline
+ * measured again. A result is a regression (or an improvement) if its median differs by more than
+ * threshold (a fraction) and the confidence intervals do not overlap, so the noise of the runs is
+ * not reported.
+ * @return the count of regressions.
+**/
+static int compare_results(const Baseline *baseline, const Baseline *current, double threshold) {
+    if (strcmp(baseline->machine, current->machine) != 0)
+        log_warn("The baseline was measured on %s, this is %s", baseline->machine, current->machine);
+    printf("\nCompared with %s on %s (threshold %.1f%%):\n", baseline->commit, baseline->machine, 100 * threshold);
+    printf("%-9s %6s %7s %14s %14s %8s  %s\n", "engine", "size", "threads", "baseline", "current", "change", "result");
+    int regressions = 0;
+    for (int r = 0; r < current->count; r++) {
+        const BenchResult *result = &current->results[r];
+        const BenchResult *base = find_result(baseline, result);
+        double change = result->generations_per_second / base->generations_per_second - 1;
+        const char *verdict = "ok";
+        if (change < -threshold && result->ci_high < base->ci_low) {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        else if (change > threshold && result->ci_low > base->ci_high) verdict = "faster";
+        printf("%-9s %6d %7d %14.1f %14.1f %+7.1f%%  %s\n", ENGINE_NAMES[result->engine], result->size,
+               result->threads, base->generations_per_second, result->generations_per_second, 100 * change, verdict);
+    }
+    return regressions;
+}
+
+/* Returns the smallest cache level the bytes fit into ("L1", "L2", "L3"), "RAM" if none. */
+static const char *memory_level(size_t bytes) {
+    const int names[] = { _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE };
+    static const char *levels[] = { "L1", "L2", "L3" };
+    for (int k = 0; k < 3; k++) {
+        long cache = sysconf(names[k]);
+        if (cache > 0 && bytes <= (size_t)cache) return levels[k];
+    }
+    return "RAM";
+}
+
+/*
+ * Parses a list of engines ("double,advance") into enabled.
+ * @return false for an unknown engine.
+**/
+static bool parse_engines(const char *str, bool enabled[ENGINE_COUNT]) {
+    memset(enabled, 0, ENGINE_COUNT * sizeof(bool));
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", str);
+    for (char *name = strtok(copy, ","); name != NULL; name = strtok(NULL, ",")) {
+        int e = 0;
+        while (e < ENGINE_COUNT && strcmp(name, ENGINE_NAMES[e]) != 0) e++;
+        if (e == ENGINE_COUNT) return false;
+        enabled[e] = true;
+    }
+    return true;
+}
+
+/*
+ * Parses a list of sizes ("64,512,4096") into sizes.
+ * @return the count of sizes, -1 if invalid.
+**/
+static int parse_sizes(const char *str, int *sizes) {
+    int count = 0;
+    const char *p = str;
+    while (*p != '\0' && count < BENCH_SIZES_MAX) {
+        char *end;
+        long size = strtol(p, &end, 10);
+        if (end == p || size < 1 || (*end != ',' && *end != '\0')) return -1;
+        sizes[count++] = size;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+/*
+ * Writes one line of the table, base is the result of the same engine and size with 1 thread
+ * (NULL if not measured, the speedup and the efficiency are left out then).
+**/
+static void print_result(const BenchResult *result, const BenchResult *base) {
+    size_t cells = (size_t)result->size * result->size;
+    size_t bytes = gol_memory_size(result->size, result->size, result->engine == ENGINE_IN_PLACE, false);
+    printf("%-9s %6d %5s %9.1f %7d %11.1f %10.1f ", ENGINE_NAMES[result->engine], result->size,
+           memory_level(bytes), bytes / 1024.0, result->threads, result->generations_per_second,
+           result->generations_per_second * cells / 1e6);
+    if (base != NULL) {
+        double speedup = result->generations_per_second / base->generations_per_second;
+        printf("%7.2f %10.0f%% ", speedup, 100 * speedup / result->threads);
+    }
+    else printf("%7s %11s ", "-", "-");
+    printf("%8.2f\n", result->generations_per_second * cells * BYTES_PER_CELL / 1e9);
+    fflush(stdout);
+}
+
+static void print_usage(const char *name) {
+    printf("Usage: %s [--threads N] [--sizes S,S,...] [--engines E,E,...] [--time SECONDS] [--repeats N]\n"
+           "       [--save FILE] [--compare FILE] [--threshold PERCENT] [--commit ID]\n", name);
+    printf("  --threads N  : Measure 1 to N threads, default the count of cores\n");
+    printf("  --sizes S,...: Width (= height) of the worlds, default 32,64,128,256,512,1024,2048,4096\n");
+    printf("  --engines E  : double, in-place and/or advance, default all\n");
+    printf("  --time S     : Seconds per measurement, default 0.2\n");
+    printf("  --repeats N  : Runs per measurement, the median is shown, default 1 (5 with --compare)\n");
+    printf("  --save FILE  : Write the results with the commit and the machine as json to FILE\n");
+    printf("  --compare F  : Measure the cases saved in F again and compare (--threads, --sizes and --engines\n");
+    printf("                 are ignored), exit code 1 on a regression or a case that cannot be measured\n");
+    printf("  --threshold P: Min slowdown in percent of a regression, default 5\n");
+    printf("  --commit ID  : The commit of the results, default from git\n");
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int sizes[BENCH_SIZES_MAX] = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    int size_count = 8;
+    bool engines[ENGINE_COUNT] = { true, true, true };
+    double seconds = 0.2, threshold = 5;
+    int repeats = 0;
+    const char *save_path = NULL, *compare_path = NULL, *commit = NULL;
+    bool cases_given = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+            cases_given = true;
+        }
+        else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            size_count = parse_sizes(argv[++i], sizes);
+            cases_given = true;
+        }
+        else if (strcmp(argv[i], "--engines") == 0 && i + 1 < argc) {
+            if (!parse_engines(argv[++i], engines)) size_count = -1;
+            cases_given = true;
+        }
+        else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) repeats = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) save_path = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) compare_path = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--commit") == 0 && i + 1 < argc) commit = argv[++i];
+        else if (strcmp(argv[i], "-h") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        else size_count = -1;
+    }
+    if (repeats == 0) repeats = compare_path != NULL ? 5 : 1;
+    if (max_threads < 1 || size_count <= 0 || seconds <= 0 || repeats < 1 || repeats > BENCH_REPEATS_MAX
+        || threshold < 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The cases: all of the baseline to compare with, otherwise every engine, size and count of threads
+    Baseline baseline;
+    BenchResult *cases;
+    int case_count = 0;
+    if (compare_path != NULL) {
+        if (!read_baseline(compare_path, &baseline)) return EXIT_FAILURE;
+        if (cases_given) fprintf(stderr, "--threads, --sizes and --engines are ignored, the cases come from %s\n", compare_path);
+        cases = malloc((baseline.count + 1) * sizeof(BenchResult));
+        for (int r = 0; r < baseline.count; r++)
+            cases[case_count++] = (BenchResult){ .engine = baseline.results[r].engine, .size = baseline.results[r].size,
+                                                 .threads = baseline.results[r].threads };
+    }
+    else {
+        cases = malloc(ENGINE_COUNT * size_count * max_threads * sizeof(BenchResult));
+        for (int e = 0; e < ENGINE_COUNT; e++) {
+            if (!engines[e]) continue;
+            for (int s = 0; s < size_count; s++)
+                for (int threads = 1; threads <= max_threads; threads++)
+                    cases[case_count++] = (BenchResult){ .engine = e, .size = sizes[s], .threads = threads };
+        }
+    }
+    Baseline current = { .results = malloc((case_count + 1) * sizeof(BenchResult)) };
+    if (commit != NULL) snprintf(current.commit, sizeof(current.commit), "%s", commit);
+    else read_commit(current.commit, sizeof(current.commit));
+    read_machine(current.machine, sizeof(current.machine));
+    log_info("Bench %s on %s: %d cases, %d x %.2f s per measurement", current.commit, current.machine,
+             case_count, repeats, seconds);
+
+    printf("%-9s %6s %5s %9s %7s %11s %10s %7s %11s %8s\n", "engine", "size", "fits", "KB", "threads",
+           "generations", "Mcells/s", "speedup", "efficiency", "GB/s");
+    for (int c = 0; c < case_count; c++) {
+        BenchResult result = cases[c];
+        double speeds[BENCH_REPEATS_MAX];
+        for (int run = 0; run < repeats; run++)
+            speeds[run] = measure(result.engine, result.size, result.threads, seconds);
+        summarize_runs(speeds, repeats, &result);
+        current.results[current.count++] = result;
+        BenchResult single = { .engine = result.engine, .size = result.size, .threads = 1 };
+        print_result(&result, find_result(&current, &single));
+    }
+    free(cases);
+
+    bool saved = save_path == NULL || save_baseline(save_path, &current);
+    int failures = 0;
+    if (compare_path != NULL) {
+        int regressions = compare_results(&baseline, &current, threshold / 100);
+        printf("%d regression%s", regressions, regressions == 1 ? "" : "s");
+        if (baseline.unmeasurable > 0) printf(", %d baseline case%s not measured", baseline.unmeasurable,
+                                              baseline.unmeasurable == 1 ? "" : "s");
+        printf("\n");
+        failures = regressions + baseline.unmeasurable;  // a regression in an unmeasured case could not be caught
+        free(baseline.results);
+    }
+    free(current.results);
+    return saved && failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
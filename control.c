@@ -0,0 +1,387 @@
+#include "control.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "timing.h"
+
+#define CONTROL_LINE_MAX 512
+#define CONTROL_POLL_MS 200  // how often the control thread checks if it should stop
+
+/*
+ * Bounded multi-producer queue (Vyukov). Every slot carries a sequence number,
+ * producers claim a slot with a CAS on enqueue_pos, the main loop is the only consumer.
+**/
+typedef struct {
+    atomic_size_t sequence;
+    ControlCommand cmd;
+} QueueSlot;
+
+static QueueSlot queue[CONTROL_QUEUE_SIZE];
+static atomic_size_t enqueue_pos;
+static size_t dequeue_pos;
+static pthread_once_t queue_once = PTHREAD_ONCE_INIT;
+
+static ControlStats published_stats;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t control_thread;
+static atomic_bool control_running;
+static int listen_fd = -1;
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static pthread_t signal_thread;
+static atomic_bool signals_running;
+
+/*
+ * @struct PendingJob
+ * @brief A job of control_run_later in the list of the signal thread.
+**/
+typedef struct PendingJob {
+    ControlJob job;
+    void *data;
+    struct PendingJob *next;
+} PendingJob;
+
+static PendingJob *pending_jobs;  // the oldest job first
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void queue_init() {
+    for (size_t i = 0; i < CONTROL_QUEUE_SIZE; i++)
+        atomic_init(&queue[i].sequence, i);
+    atomic_init(&enqueue_pos, 0);
+    dequeue_pos = 0;
+}
+
+bool control_push(const ControlCommand *cmd) {
+    pthread_once(&queue_once, queue_init);
+    QueueSlot *slot;
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        slot = &queue[pos & (CONTROL_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) return false;  // queue is full
+        else pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    }
+    slot->cmd = *cmd;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+bool control_pop(ControlCommand *cmd) {
+    pthread_once(&queue_once, queue_init);
+    QueueSlot *slot = &queue[dequeue_pos & (CONTROL_QUEUE_SIZE - 1)];
+    size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (seq != dequeue_pos + 1) return false;  // queue is empty
+    *cmd = slot->cmd;
+    atomic_store_explicit(&slot->sequence, dequeue_pos + CONTROL_QUEUE_SIZE, memory_order_release);
+    dequeue_pos++;
+    return true;
+}
+
+void control_publish_stats(const ControlStats *stats) {
+    pthread_mutex_lock(&stats_mutex);
+    published_stats = *stats;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void control_get_stats(ControlStats *stats) {
+    pthread_mutex_lock(&stats_mutex);
+    *stats = published_stats;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+/*
+ * Sends the string to the client, ignores errors (the client may be gone).
+**/
+static void reply(int fd, const char *msg) {
+    size_t len = strlen(msg);
+    while (len > 0) {
+        ssize_t n = send(fd, msg, len, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        msg += n;
+        len -= n;
+    }
+}
+
+/*
+ * Parses a positive integer argument.
+ * @return the value or -1 if the string is not a positive integer.
+**/
+static int parse_positive(const char *str) {
+    if (str == NULL) return -1;
+    char *end;
+    long value = strtol(str, &end, 10);
+    if (*end != '\0' || value <= 0 || value > 1 << 30) return -1;
+    return (int)value;
+}
+
+/*
+ * Handles one command line of a client and writes the answer to the client.
+ * @param fd: the client socket.
+ * @param line: the command line without the newline.
+**/
+static void handle_command_line(int fd, char *line) {
+    char *save = NULL;
+    char *name = strtok_r(line, " \t\r", &save);
+    char *arg = strtok_r(NULL, " \t\r", &save);
+    if (name == NULL) return;
+
+    ControlCommand cmd = { 0 };
+    if (strcmp(name, "pause") == 0) cmd.type = CMD_PAUSE;
+    else if (strcmp(name, "resume") == 0) cmd.type = CMD_RESUME;
+    else if (strcmp(name, "reset") == 0) cmd.type = CMD_RESET;
+    else if (strcmp(name, "quit") == 0) cmd.type = CMD_QUIT;
+    else if (strcmp(name, "step") == 0) {
+        cmd.type = CMD_STEP;
+        cmd.value = arg == NULL ? 1 : parse_positive(arg);
+        if (cmd.value < 0) { reply(fd, "error: step needs a positive count\n"); return; }
+    }
+    else if (strcmp(name, "threads") == 0) {
+        cmd.type = CMD_THREADS;
+        cmd.value = parse_positive(arg);
+        if (cmd.value < 0) { reply(fd, "error: threads needs a positive count\n"); return; }
+    }
+    else if (strcmp(name, "rule") == 0) {
+        cmd.type = CMD_RULE;
+        if (!parse_rule(arg, &cmd.rule)) { reply(fd, "error: invalid rule, expected e.g. B3/S23\n"); return; }
+    }
+    else if (strcmp(name, "snapshot") == 0 || strcmp(name, "load") == 0 || strcmp(name, "rle") == 0) {
+        cmd.type = name[0] == 's' ? CMD_SNAPSHOT : name[0] == 'l' ? CMD_LOAD : CMD_RLE;
+        if (arg == NULL || strlen(arg) >= CONTROL_ARG_MAX) { reply(fd, "error: missing or too long path\n"); return; }
+        strcpy(cmd.arg, arg);
+    }
+    else if (strcmp(name, "stats") == 0) {
+        ControlStats s;
+        char rule[RULE_STRING_MAX];
+        char buffer[CONTROL_LINE_MAX];
+        control_get_stats(&s);
+        format_rule(&s.rule, rule, sizeof(rule));
+        snprintf(buffer, sizeof(buffer),
+                 "generation=%ld population=%ld size=%dx%d rule=%s threads=%d paused=%d "
+                 "last_calc_time=%.6f avg_calc_time=%.6f hash=%016llx\n",
+                 s.generation, s.population, s.width, s.height, rule, s.threads, s.paused,
+                 s.last_calc_time, s.avg_calc_time, (unsigned long long)s.hash);
+        reply(fd, buffer);
+        return;
+    }
+    else if (strcmp(name, "help") == 0) {
+        reply(fd, "commands: pause resume step [N] rule B3/S23 threads N "
+                  "snapshot PATH rle PATH load PATH reset stats quit\n");
+        return;
+    }
+    else { reply(fd, "error: unknown command\n"); return; }
+
+    if (!control_push(&cmd)) { reply(fd, "error: command queue is full\n"); return; }
+    log_info("Control command: %s %s", name, arg == NULL ? "" : arg);
+    reply(fd, "ok\n");
+}
+
+/*
+ * Reads command lines from one client until it disconnects or the thread is stopped.
+ * @param fd: the client socket.
+**/
+static void handle_client(int fd) {
+    char line[CONTROL_LINE_MAX];
+    size_t len = 0;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (atomic_load(&control_running)) {
+        int ready = poll(&pfd, 1, CONTROL_POLL_MS);
+        if (ready < 0 && errno != EINTR) return;
+        if (ready <= 0) continue;
+
+        ssize_t n = read(fd, line + len, sizeof(line) - 1 - len);
+        if (n <= 0) return;
+        len += n;
+
+        char *newline;
+        while ((newline = memchr(line, '\n', len)) != NULL) {
+            *newline = '\0';
+            size_t consumed = newline - line + 1;
+            handle_command_line(fd, line);
+            memmove(line, line + consumed, len - consumed);
+            len -= consumed;
+        }
+        if (len == sizeof(line) - 1) {
+            reply(fd, "error: line too long\n");
+            len = 0;
+        }
+    }
+}
+
+static void *control_thread_main(void *arg) {
+    (void)arg;
+    struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+    while (atomic_load(&control_running)) {
+        int ready = poll(&pfd, 1, CONTROL_POLL_MS);
+        if (ready <= 0) continue;
+        int client = accept(listen_fd, NULL, NULL);
+        if (client < 0) continue;
+        handle_client(client);
+        close(client);
+    }
+    return NULL;
+}
+
+bool control_start(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (path == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+        log_error("Invalid control socket path.");
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        log_error("Cannot create control socket: %s", strerror(errno));
+        return false;
+    }
+    unlink(path);  // remove a stale socket of an old run
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 4) < 0) {
+        log_error("Cannot listen on control socket %s: %s", path, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    strcpy(socket_path, path);
+
+    atomic_store(&control_running, true);
+    if (pthread_create(&control_thread, NULL, control_thread_main, NULL) != 0) {
+        log_error("Cannot start control thread.");
+        atomic_store(&control_running, false);
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+        return false;
+    }
+    log_info("Control socket listening on %s", path);
+    return true;
+}
+
+void control_stop() {
+    if (listen_fd < 0) return;
+    atomic_store(&control_running, false);
+    pthread_join(control_thread, NULL);
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path);
+}
+
+/*
+ * Returns the resident set size of the process in bytes, 0 if unknown.
+**/
+static unsigned long get_rss_bytes() {
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file == NULL) return 0;
+    unsigned long pages_total = 0, pages_resident = 0;
+    if (fscanf(file, "%lu %lu", &pages_total, &pages_resident) != 2) pages_resident = 0;
+    fclose(file);
+    return pages_resident * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Writes the last published stats, the memory usage and the phase histograms to the log.
+**/
+static void log_stats_dump() {
+    ControlStats s;
+    char rule[RULE_STRING_MAX];
+    control_get_stats(&s);
+    format_rule(&s.rule, rule, sizeof(rule));
+    log_info("Stats: generation=%ld population=%ld size=%dx%d rule=%s threads=%d paused=%d",
+             s.generation, s.population, s.width, s.height, rule, s.threads, s.paused);
+    log_info("Memory: game=%lu bytes rss=%lu bytes", s.memory_bytes, get_rss_bytes());
+    timing_log_histograms();
+}
+
+/* Runs and removes all waiting jobs of control_run_later. */
+static void run_pending_jobs() {
+    pthread_mutex_lock(&jobs_mutex);
+    PendingJob *jobs = pending_jobs;
+    pending_jobs = NULL;
+    pthread_mutex_unlock(&jobs_mutex);
+    while (jobs != NULL) {
+        PendingJob *next = jobs->next;
+        jobs->job(jobs->data);
+        free(jobs);
+        jobs = next;
+    }
+}
+
+void control_run_later(ControlJob job, void *data) {
+    if (!atomic_load(&signals_running)) {
+        job(data);
+        return;
+    }
+    PendingJob *pending = malloc(sizeof(PendingJob));
+    *pending = (PendingJob){ .job = job, .data = data };
+    pthread_mutex_lock(&jobs_mutex);
+    PendingJob **last = &pending_jobs;
+    while (*last != NULL) last = &(*last)->next;
+    *last = pending;
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+static void *signal_thread_main(void *arg) {
+    (void)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    struct timespec timeout = { .tv_sec = 0, .tv_nsec = CONTROL_POLL_MS * 1000000L };
+    int snapshot_count = 0;
+
+    while (atomic_load(&signals_running)) {
+        int sig = sigtimedwait(&set, NULL, &timeout);
+        if (sig == SIGUSR1) log_stats_dump();
+        else if (sig == SIGUSR2) {
+            ControlCommand cmd = { .type = CMD_SNAPSHOT };
+            snprintf(cmd.arg, sizeof(cmd.arg), "snapshot_%ld_%d.cells", (long)time(NULL), snapshot_count++);
+            if (!control_push(&cmd)) log_warn("Command queue is full, snapshot dropped.");
+        }
+        run_pending_jobs();
+    }
+    return NULL;
+}
+
+bool control_start_signals() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) {
+        log_error("Cannot block SIGUSR1 and SIGUSR2.");
+        return false;
+    }
+    atomic_store(&signals_running, true);
+    if (pthread_create(&signal_thread, NULL, signal_thread_main, NULL) != 0) {
+        log_error("Cannot start signal thread.");
+        atomic_store(&signals_running, false);
+        return false;
+    }
+    return true;
+}
+
+void control_stop_signals() {
+    if (!atomic_load(&signals_running)) return;
+    atomic_store(&signals_running, false);
+    pthread_join(signal_thread, NULL);
+    run_pending_jobs();  // jobs added during the last wait
+}
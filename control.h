@@ -0,0 +1,86 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdbool.h>
+#include "rule.h"
+
+#define CONTROL_QUEUE_SIZE 64  // must be a power of two
+#define CONTROL_ARG_MAX 256
+
+typedef enum {
+    CMD_PAUSE,
+    CMD_RESUME,
+    CMD_STEP,
+    CMD_RULE,
+    CMD_THREADS,
+    CMD_SNAPSHOT,
+    CMD_LOAD,
+    CMD_RLE,
+    CMD_RESET,
+    CMD_QUIT
+} ControlCommandType;
+
+/*
+ * @struct ControlCommand
+ * @brief A command for the game, applied by the main loop at the next generation boundary.
+ * @param type: the type of the command.
+ * @param value: the step count or thread count.
+ * @param rule: the parsed rule for CMD_RULE.
+ * @param arg: the file path for CMD_SNAPSHOT, CMD_LOAD and CMD_RLE.
+**/
+typedef struct {
+    ControlCommandType type;  /* @brief the type of the command. */
+    int value;  /* @brief the step count or thread count. */
+    Rule rule;  /* @brief the parsed rule for CMD_RULE. */
+    char arg[CONTROL_ARG_MAX];  /* @brief the file path for CMD_SNAPSHOT, CMD_LOAD and CMD_RLE. */
+} ControlCommand;
+
+/*
+ * @struct ControlStats
+ * @brief The stats published by the main loop once per generation, answered to the stats query.
+**/
+typedef struct {
+    long generation;
+    long population;
+    int width;
+    int height;
+    int threads;
+    bool paused;
+    double last_calc_time;
+    double avg_calc_time;
+    Rule rule;
+    unsigned long memory_bytes;  // memory used by the world (gol_memory_size) and the history
+    uint64_t hash;  // the hash of the cells (gol_hash)
+} ControlStats;
+
+/* Starts the control thread listening on the unix socket at path, returns false on error. */
+bool control_start(const char *path);
+/* Stops the control thread and removes the socket. */
+void control_stop();
+/* Adds a command to the queue, safe to call from any thread. Returns false if the queue is full. */
+bool control_push(const ControlCommand *cmd);
+/* Takes the next command from the queue, only called by the main loop. Returns false if empty. */
+bool control_pop(ControlCommand *cmd);
+/*
+ * Blocks SIGUSR1 and SIGUSR2 and starts a thread waiting for them: SIGUSR1 writes the stats and
+ * timing histograms to the log, SIGUSR2 requests a snapshot. Must be called before any other
+ * thread is started, so that all threads inherit the signal mask.
+**/
+bool control_start_signals();
+/* Stops the signal thread, runs the jobs of control_run_later that are still waiting first. */
+void control_stop_signals();
+
+/* A job for the signal thread, frees its data. */
+typedef void (*ControlJob)(void *data);
+/*
+ * Hands a job (e.g. writing a pinned snapshot to a file) to the signal thread, which runs it within
+ * about CONTROL_POLL_MS, so the main loop does not wait for the file. Runs the job right away if the
+ * signal thread is not running.
+**/
+void control_run_later(ControlJob job, void *data);
+/* Publishes the stats of the current generation. */
+void control_publish_stats(const ControlStats *stats);
+/* Copies the last published stats into stats. */
+void control_get_stats(ControlStats *stats);
+
+#endif /* CONTROL_H */
@@ -0,0 +1,229 @@
+#include "export.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "logger.h"
+
+#define EXPORT_MAX_COLORS 256
+
+/*
+ * @struct ExportJob
+ * @brief One queued frame.
+ * @param pixels: the palette indices, NULL until fill wrote them.
+ * @param fill: writes the palette indices in the worker.
+ * @param data: the data of fill.
+**/
+typedef struct {
+    long generation;
+    int width;
+    int height;
+    unsigned char *pixels;
+    FrameFill fill;
+    void *data;
+} ExportJob;
+
+struct FrameExporter {
+    char dir[256];
+    ExportFormat format;
+    unsigned char palette[EXPORT_MAX_COLORS][3];
+    int colors;
+
+    ExportJob *jobs;  // ring buffer of max_queued jobs
+    int max_queued;
+    int head;
+    int count;
+    bool stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    pthread_t *threads;
+    int workers;
+};
+
+bool parse_export_format(const char *str, ExportFormat *format) {
+    if (strcmp(str, "png") == 0) *format = EXPORT_PNG;
+    else if (strcmp(str, "ppm") == 0) *format = EXPORT_PPM;
+    else if (strcmp(str, "raw") == 0) *format = EXPORT_RAW;
+    else return false;
+    return true;
+}
+
+/*
+ * Writes one png chunk with its length and crc.
+**/
+static void write_png_chunk(FILE *file, const char *type, const unsigned char *data, uint32_t len) {
+    uint32_t be_len = htonl(len);
+    fwrite(&be_len, 4, 1, file);
+    fwrite(type, 1, 4, file);
+    if (len > 0) fwrite(data, 1, len, file);
+    uint32_t crc = crc32(0, (const unsigned char *)type, 4);
+    if (len > 0) crc = crc32(crc, data, len);
+    uint32_t be_crc = htonl(crc);
+    fwrite(&be_crc, 4, 1, file);
+}
+
+/*
+ * Writes the frame as an 8 bit indexed png, the palette indices are used directly.
+**/
+static bool write_png(FrameExporter *e, const ExportJob *job, FILE *file) {
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite(signature, 1, 8, file);
+
+    unsigned char header[13];
+    uint32_t be_width = htonl(job->width), be_height = htonl(job->height);
+    memcpy(header, &be_width, 4);
+    memcpy(header + 4, &be_height, 4);
+    header[8] = 8;  // bit depth
+    header[9] = 3;  // indexed color
+    header[10] = header[11] = header[12] = 0;
+    write_png_chunk(file, "IHDR", header, sizeof(header));
+    write_png_chunk(file, "PLTE", &e->palette[0][0], e->colors * 3);
+
+    // Every row starts with the filter type 0 (none)
+    size_t raw_size = (size_t)(job->width + 1) * job->height;
+    unsigned char *raw = malloc(raw_size);
+    for (int y = 0; y < job->height; y++) {
+        raw[(size_t)y * (job->width + 1)] = 0;
+        memcpy(raw + (size_t)y * (job->width + 1) + 1, job->pixels + (size_t)y * job->width, job->width);
+    }
+    uLongf compressed_size = compressBound(raw_size);
+    unsigned char *compressed = malloc(compressed_size);
+    bool ok = compress2(compressed, &compressed_size, raw, raw_size, Z_BEST_SPEED) == Z_OK;
+    if (ok) write_png_chunk(file, "IDAT", compressed, compressed_size);
+    write_png_chunk(file, "IEND", NULL, 0);
+    free(compressed);
+    free(raw);
+    return ok;
+}
+
+/*
+ * Writes the rgb values of the frame, used for ppm and raw frames.
+**/
+static void write_rgb(FrameExporter *e, const ExportJob *job, FILE *file) {
+    size_t count = (size_t)job->width * job->height;
+    unsigned char *rgb = malloc(count * 3);
+    for (size_t i = 0; i < count; i++)
+        memcpy(rgb + i * 3, e->palette[job->pixels[i] < e->colors ? job->pixels[i] : 0], 3);
+    fwrite(rgb, 3, count, file);
+    free(rgb);
+}
+
+/*
+ * Encodes and writes one job.
+**/
+static void write_job(FrameExporter *e, const ExportJob *job) {
+    if (e->format == EXPORT_RAW) {
+        write_rgb(e, job, stdout);
+        fflush(stdout);
+        return;
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s/gen_%08ld.%s", e->dir, job->generation, e->format == EXPORT_PNG ? "png" : "ppm");
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        log_error("Cannot write frame %s", path);
+        return;
+    }
+    if (e->format == EXPORT_PNG) {
+        if (!write_png(e, job, file)) log_error("Cannot compress frame %s", path);
+    }
+    else {
+        fprintf(file, "P6\n%d %d\n255\n", job->width, job->height);
+        write_rgb(e, job, file);
+    }
+    fclose(file);
+}
+
+static void *export_worker(void *arg) {
+    FrameExporter *e = arg;
+    for (;;) {
+        pthread_mutex_lock(&e->mutex);
+        while (e->count == 0 && !e->stopping)
+            pthread_cond_wait(&e->not_empty, &e->mutex);
+        if (e->count == 0) {  // stopping and nothing left
+            pthread_mutex_unlock(&e->mutex);
+            return NULL;
+        }
+        ExportJob job = e->jobs[e->head];
+        e->head = (e->head + 1) % e->max_queued;
+        e->count--;
+        pthread_cond_signal(&e->not_full);
+        pthread_mutex_unlock(&e->mutex);
+
+        job.pixels = malloc((size_t)job.width * job.height);
+        job.fill(job.data, job.pixels);
+        write_job(e, &job);
+        free(job.pixels);
+    }
+}
+
+FrameExporter *create_frame_exporter(const char *dir, ExportFormat format, int workers, int max_queued,
+                                     const unsigned char palette[][3], int colors) {
+    if (format != EXPORT_RAW) {
+        if (dir == NULL || strlen(dir) >= sizeof(((FrameExporter *)0)->dir)) {
+            log_error("Invalid export directory.");
+            return NULL;
+        }
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            log_error("Cannot create export directory %s: %s", dir, strerror(errno));
+            return NULL;
+        }
+    }
+    FrameExporter *e = calloc(1, sizeof(FrameExporter));
+    if (dir != NULL) snprintf(e->dir, sizeof(e->dir), "%s", dir);
+    e->format = format;
+    e->colors = colors < EXPORT_MAX_COLORS ? colors : EXPORT_MAX_COLORS;
+    memcpy(e->palette, palette, e->colors * 3);
+    e->max_queued = max_queued > 0 ? max_queued : 1;
+    e->jobs = calloc(e->max_queued, sizeof(ExportJob));
+    pthread_mutex_init(&e->mutex, NULL);
+    pthread_cond_init(&e->not_empty, NULL);
+    pthread_cond_init(&e->not_full, NULL);
+
+    e->workers = format == EXPORT_RAW || workers < 1 ? 1 : workers;  // raw frames must stay in order
+    e->threads = calloc(e->workers, sizeof(pthread_t));
+    for (int i = 0; i < e->workers; i++)
+        pthread_create(&e->threads[i], NULL, export_worker, e);
+    log_info("Exporting frames to %s with %d workers", format == EXPORT_RAW ? "stdout" : dir, e->workers);
+    return e;
+}
+
+/* Adds the job to the queue, blocks while the queue is full. */
+static void queue_job(FrameExporter *e, const ExportJob *job) {
+    pthread_mutex_lock(&e->mutex);
+    while (e->count == e->max_queued)
+        pthread_cond_wait(&e->not_full, &e->mutex);
+    e->jobs[(e->head + e->count) % e->max_queued] = *job;
+    e->count++;
+    pthread_cond_signal(&e->not_empty);
+    pthread_mutex_unlock(&e->mutex);
+}
+
+void export_frame_deferred(FrameExporter *e, long generation, int width, int height, FrameFill fill, void *data) {
+    queue_job(e, &(ExportJob){ .generation = generation, .width = width, .height = height, .fill = fill, .data = data });
+}
+
+void free_frame_exporter(FrameExporter *e) {
+    if (e == NULL) return;
+    pthread_mutex_lock(&e->mutex);
+    e->stopping = true;
+    pthread_cond_broadcast(&e->not_empty);
+    pthread_mutex_unlock(&e->mutex);
+    for (int i = 0; i < e->workers; i++)
+        pthread_join(e->threads[i], NULL);
+    pthread_mutex_destroy(&e->mutex);
+    pthread_cond_destroy(&e->not_empty);
+    pthread_cond_destroy(&e->not_full);
+    free(e->threads);
+    free(e->jobs);
+    free(e);
+}
@@ -0,0 +1,38 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdbool.h>
+
+typedef enum {
+    EXPORT_PNG,
+    EXPORT_PPM,
+    EXPORT_RAW  /* raw rgb24 frames to stdout, e.g. for ffmpeg -f rawvideo */
+} ExportFormat;
+
+typedef struct FrameExporter FrameExporter;
+
+/*
+ * Writes the palette indices of a frame (width * height bytes, row by row) into pixels and frees data.
+ * Called by a worker of the exporter, so it must not touch state the caller still changes.
+**/
+typedef void (*FrameFill)(void *data, unsigned char *pixels);
+
+/*
+ * Creates an exporter writing frames to dir (ignored for EXPORT_RAW) with workers encoding threads.
+ * At most max_queued frames are kept in memory, export_frame_deferred blocks if the queue is full.
+ * palette holds the rgb values of the palette indices of the frames.
+ * Returns NULL on error.
+**/
+FrameExporter *create_frame_exporter(const char *dir, ExportFormat format, int workers, int max_queued,
+                                     const unsigned char palette[][3], int colors);
+/*
+ * Queues a frame whose palette indices are written by fill(data, pixels) in a worker, so the caller
+ * only has to keep the data of the frame alive (e.g. with a snapshot) instead of converting it.
+**/
+void export_frame_deferred(FrameExporter *exporter, long generation, int width, int height, FrameFill fill, void *data);
+/* Waits until all queued frames are written and frees the exporter. */
+void free_frame_exporter(FrameExporter *exporter);
+/* Parses "png", "ppm" or "raw", returns false for an unknown format. */
+bool parse_export_format(const char *str, ExportFormat *format);
+
+#endif /* EXPORT_H */
@@ -0,0 +1,886 @@
+#include "gol.h"
+
+#include <math.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+
+#define FILL_DENSITY_BITS 16  // precision of the density of gol_fill_random
+#define FILL_CHUNK_WORDS 1024  // 64 bit words (cells / 64) per random stream of gol_fill_random
+#define PACK_BYTES 0x0102040810204080ULL  // multiplier moving bit 0 of byte k to bit 56 + k
+#define SLICE_CELLS (1L << 18)  // cells per thread of gol_step_slice between two checks of the time
+#define TRAPEZOID_BASE_CELLS (1L << 14)  // smaller trapezoids of gol_advance are stepped row by row
+#define TRAPEZOID_TASK_CELLS (1L << 18)  // smaller trapezoids of gol_advance are not split into tasks
+
+struct GolBuffer {
+    int refs;  // the world and every snapshot hold one reference
+    uint8_t cells[];
+};
+
+static void complete_sliced_step(GolWorld *world);
+static void free_slice(GolSlice *slice);
+
+static GolBuffer *create_buffer(size_t count) {
+    GolBuffer *buffer = calloc(1, sizeof(GolBuffer) + count);
+    buffer->refs = 1;
+    return buffer;
+}
+
+static void release_buffer(GolBuffer *buffer) {
+    if (buffer != NULL && __atomic_sub_fetch(&buffer->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(buffer);
+}
+
+/*
+ * Makes the buffer of the next generation the current one. The old buffer is kept for the step
+ * after it, unless a snapshot still holds it.
+**/
+static void swap_buffers(GolWorld *world, GolBuffer *next) {
+    GolBuffer *old = world->current;
+    world->current = next;
+    world->alive = next->cells;
+    world->spare = NULL;
+    if (__atomic_load_n(&old->refs, __ATOMIC_ACQUIRE) == 1) world->spare = old;
+    else release_buffer(old);
+}
+
+/*
+ * splitmix64, a small and fast generator with a 64 bit state.
+**/
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* The random key of the cell at index for the hash, the splitmix64 output of the index. */
+static inline uint64_t cell_key(size_t index) {
+    uint64_t state = index;
+    return next_random(&state);
+}
+
+/* Allocates the change mask and the dirty tiles for the size of the world. */
+static void create_change_planes(GolWorld *world) {
+    world->change_words = (world->width + 63) / 64;
+    world->changes = calloc((size_t)world->height * world->change_words, sizeof(uint64_t));
+    world->dirty_tiles = calloc((size_t)gol_tile_rows(world) * world->change_words, 1);
+}
+
+/* Marks all cells as changed, after writes the change mask does not know. */
+static void mark_all_changed(GolWorld *world) {
+    int tail = world->width % 64;
+    for (int i = 0; i < world->height; i++) {
+        uint64_t *row = world->changes + (size_t)i * world->change_words;
+        memset(row, 0xff, world->change_words * sizeof(uint64_t));
+        if (tail != 0) row[world->change_words - 1] = (1ULL << tail) - 1;
+    }
+    memset(world->dirty_tiles, 1, (size_t)gol_tile_rows(world) * world->change_words);
+    world->changed = (long)world->width * world->height;
+}
+
+GolWorld *gol_create(int width, int height, const Rule *rule) {
+    if (width < 1 || height < 1) {
+        log_error("Invalid world size %dx%d", width, height);
+        return NULL;
+    }
+    GolWorld *world = calloc(1, sizeof(GolWorld));
+    size_t count = (size_t)width * height;
+    world->width = width;
+    world->height = height;
+    world->rule = rule != NULL ? *rule : default_rule();
+    world->num_threads = 1;
+    world->current = create_buffer(count);
+    world->alive = world->current->cells;
+    world->births = calloc(count, sizeof(uint32_t));
+    create_change_planes(world);
+    mark_all_changed(world);
+    return world;
+}
+
+void gol_free(GolWorld *world) {
+    if (world == NULL) return;
+    free_slice(world->slice);
+    release_buffer(world->current);
+    release_buffer(world->spare);
+    free(world->births);
+    free(world->heat);
+    free(world->changes);
+    free(world->dirty_tiles);
+    free_density_pyramid(world->pyramid);
+    free(world);
+}
+
+/*
+ * Writes the change mask of row i from the old and the new cells and marks the tiles with changes
+ * (only the hash and the count if not mark). 8 cells are compared at once, the 8 bytes of 0 or 1 are
+ * packed into 8 bits with one multiplication.
+ * The keys of the changed cells are xored into hash.
+ * @return the count of changed cells of the row.
+**/
+static long pack_changes(GolWorld *world, int i, const uint8_t *old_row, const uint8_t *new_row, bool mark,
+                         uint64_t *hash) {
+    int width = world->width;
+    uint64_t *changes = world->changes + (size_t)i * world->change_words;
+    uint8_t *tiles = world->dirty_tiles + (size_t)(i / GOL_TILE_ROWS) * world->change_words;
+    long changed = 0;
+    for (int w = 0; w < world->change_words; w++) {
+        int first = w * 64, count = width - first < 64 ? width - first : 64;
+        uint64_t bits = 0;
+        for (int k = 0; k < count; k += 8) {
+            uint64_t old_bytes = 0, new_bytes = 0;
+            size_t n = count - k < 8 ? count - k : 8;
+            memcpy(&old_bytes, old_row + first + k, n);
+            memcpy(&new_bytes, new_row + first + k, n);
+            bits |= ((old_bytes ^ new_bytes) * PACK_BYTES) >> 56 << k;
+        }
+        if (mark) changes[w] = bits;
+        if (bits == 0) continue;
+        changed += __builtin_popcountll(bits);
+        size_t index = (size_t)i * width + first;
+        for (uint64_t rest = bits; rest != 0; rest &= rest - 1)
+            *hash ^= cell_key(index + __builtin_ctzll(rest));
+        if (mark) __atomic_store_n(&tiles[w], 1, __ATOMIC_RELAXED);  // the rows of a tile may be in several threads
+    }
+    return changed;
+}
+
+/*
+ * Counts the alive neighbours of every cell of a row, 8 cells per 64 bit word (SWAR): first the vertical
+ * sums of the 3 rows, then the sum of 3 neighbouring vertical sums minus the cell itself.
+ * A lane never gets above 9, so no lane carries into the next one and there are no bounds checks.
+ * @param up: the row above, a dead row at the top border.
+ * @param mid: the row of the cells.
+ * @param down: the row below, a dead row at the bottom border.
+ * @param sums: width + 16 bytes, zero after the allocation, the vertical sums with a dead column on both sides.
+ * @param counts: width + 8 bytes, the counts of the cells.
+**/
+static void count_neighbours(const uint8_t *up, const uint8_t *mid, const uint8_t *down, int width,
+                             uint8_t *sums, uint8_t *counts) {
+    uint64_t a, b, c;
+    int j = 0;
+    for (; j + 8 <= width; j += 8) {
+        memcpy(&a, up + j, 8);
+        memcpy(&b, mid + j, 8);
+        memcpy(&c, down + j, 8);
+        a += b + c;
+        memcpy(sums + 1 + j, &a, 8);
+    }
+    for (; j < width; j++)
+        sums[1 + j] = up[j] + mid[j] + down[j];
+    for (j = 0; j < width; j += 8) {
+        uint64_t self = 0;
+        memcpy(&a, sums + j, 8);
+        memcpy(&b, sums + j + 1, 8);
+        memcpy(&c, sums + j + 2, 8);
+        memcpy(&self, mid + j, width - j < 8 ? width - j : 8);
+        a += b + c - self;  // the middle sum contains the cell, so no lane borrows
+        memcpy(counts + j, &a, 8);
+    }
+}
+
+/*
+ * @struct StepContext
+ * @brief The settings shared by all rows of one step.
+ * @param world: the world to step.
+ * @param next_state: the next state by the state and the count of alive neighbours.
+ * @param count_changes: true if the activity counters count changes, false if alive cells.
+ * @param birth: the birth of the cells born in this step, they are 1 generation old after it.
+ * @param mark_changes: true if the step writes the change mask and the dirty tiles (the last step of a walk).
+ * @param dead_row: a row of dead cells, the neighbours outside of the world.
+ * @param deferred: true if the heat and the pyramid are updated after the last row (a sliced step), so
+ *                  that they keep showing the current generation until the buffers are swapped.
+ * @param pyramid_deltas: the level 1 deltas of a deferred step (widths[1] per row), NULL without pyramid.
+**/
+typedef struct {
+    GolWorld *world;
+    uint8_t next_state[2][9];
+    bool count_changes;
+    uint32_t birth;
+    bool mark_changes;
+    uint8_t *dead_row;
+    bool deferred;
+    int32_t *pyramid_deltas;
+} StepContext;
+
+/*
+ * @struct RowScratch
+ * @brief The row buffers of one thread.
+ * @param sums: the vertical sums of count_neighbours.
+ * @param counts: the counts of alive neighbours of the row.
+ * @param pyramid_deltas: the changes of the population of the blocks of level 1 of the pyramid.
+ * @param pyramid_row: the row of level 1 of pyramid_deltas, -1 if there are none.
+ * @param pyramid_cells: the rows of cells of pyramid_row in pyramid_deltas (bit 0 upper, bit 1 lower row).
+**/
+typedef struct {
+    uint8_t *sums;
+    uint8_t *counts;
+    int32_t *pyramid_deltas;
+    int pyramid_row;
+    uint8_t pyramid_cells;
+} RowScratch;
+
+static RowScratch create_row_scratch(int width) {
+    return (RowScratch){ .sums = calloc(width + 16, 1), .counts = malloc(width + 8),
+                         .pyramid_deltas = calloc(width / 2 + 1, sizeof(int32_t)), .pyramid_row = -1 };
+}
+
+static void free_row_scratch(RowScratch *scratch) {
+    free(scratch->sums);
+    free(scratch->counts);
+    free(scratch->pyramid_deltas);
+}
+
+/*
+ * Adds the collected deltas of the scratch to level 1 of the pyramid (or to the deltas of a deferred step),
+ * before the pyramid is propagated. Every row is stepped by one thread and parallel trapezoids have
+ * separate rows, so if the thread collected both rows of the blocks no other thread writes them and the
+ * adds need not be atomic.
+**/
+static void flush_pyramid_deltas(const StepContext *ctx, RowScratch *scratch) {
+    if (scratch->pyramid_row < 0) return;
+    GolWorld *world = ctx->world;
+    uint8_t all_cells = scratch->pyramid_row * 2 + 1 < world->height ? 3 : 1;
+    bool shared = scratch->pyramid_cells != all_cells;
+    if (ctx->deferred) {
+        int width = world->pyramid->widths[1];
+        int32_t *deltas = ctx->pyramid_deltas + (size_t)scratch->pyramid_row * width;
+        for (int x = 0; x < width; x++) {
+            if (scratch->pyramid_deltas[x] == 0) continue;
+            if (shared) __atomic_fetch_add(&deltas[x], scratch->pyramid_deltas[x], __ATOMIC_RELAXED);
+            else deltas[x] += scratch->pyramid_deltas[x];
+            scratch->pyramid_deltas[x] = 0;
+        }
+    }
+    else pyramid_add_row(world->pyramid, scratch->pyramid_row, scratch->pyramid_deltas, shared);
+    scratch->pyramid_row = -1;
+    scratch->pyramid_cells = 0;
+}
+
+/*
+ * Sums the changes of row i per block of level 1 of the pyramid in the scratch. The deltas are added when
+ * the thread continues at another row of level 1, so the two rows of a block cost one add per changed
+ * block instead of one atomic add per changed cell.
+**/
+static void collect_pyramid_deltas(const StepContext *ctx, RowScratch *scratch, int i, const uint8_t *old_row,
+                                   const uint8_t *new_row) {
+    GolWorld *world = ctx->world;
+    int width = world->width;
+    if (world->pyramid->levels < 2) return;
+    if (scratch->pyramid_row != i >> 1) {
+        flush_pyramid_deltas(ctx, scratch);
+        scratch->pyramid_row = i >> 1;
+    }
+    scratch->pyramid_cells |= 1 << (i & 1);
+    int32_t *deltas = scratch->pyramid_deltas;
+    for (int j = 0; j + 1 < width; j += 2)
+        deltas[j >> 1] += new_row[j] + new_row[j + 1] - old_row[j] - old_row[j + 1];
+    if (width % 2 == 1) deltas[width >> 1] += new_row[width - 1] - old_row[width - 1];
+}
+
+/* Adds the activity of row i from the old to the new cells to the activity counters (saturating). */
+static void add_heat_row(const StepContext *ctx, int i, const uint8_t *old_row, const uint8_t *new_row) {
+    int width = ctx->world->width;
+    uint16_t *heat = ctx->world->heat + (size_t)i * width;
+    for (int j = 0; j < width; j++) {
+        unsigned int value = heat[j] + (ctx->count_changes ? new_row[j] != old_row[j] : new_row[j]);
+        heat[j] = value > UINT16_MAX ? UINT16_MAX : value;
+    }
+}
+
+/*
+ * Calculates row i of the next generation from the old rows up, old_row and down into new_row.
+ * The births, the activity counters (if enabled) and the change mask are updated on the way, the changes of the
+ * density pyramid (if enabled) are collected in the scratch. new_row may be the row of old_row in the
+ * world, old_row has to be a copy then.
+**/
+static void step_row(const StepContext *ctx, RowScratch *scratch, int i, const uint8_t *up, const uint8_t *old_row,
+                     const uint8_t *down, uint8_t *new_row, long *population, long *changed, uint64_t *hash) {
+    GolWorld *world = ctx->world;
+    int width = world->width;
+    uint32_t *births = world->births + (size_t)i * width;
+    count_neighbours(up, old_row, down, width, scratch->sums, scratch->counts);
+    for (int j = 0; j < width; j++) {
+        bool was_alive = old_row[j];
+        bool alive = ctx->next_state[was_alive][scratch->counts[j]];
+        new_row[j] = alive;
+        if (alive && !was_alive) births[j] = ctx->birth;  // surviving cells cost no write
+        *population += alive;
+    }
+
+    // Saturating add of the row, a separate loop so that it is vectorized
+    if (world->heat != NULL && !ctx->deferred) add_heat_row(ctx, i, old_row, new_row);
+    *changed += pack_changes(world, i, old_row, new_row, ctx->mark_changes, hash);
+    if (world->pyramid != NULL) collect_pyramid_deltas(ctx, scratch, i, old_row, new_row);
+}
+
+/* Calculates the rows first to last (exclusive) of the next generation into dst, in parallel with num_threads. */
+static void step_rows(const StepContext *ctx, uint8_t *dst, int first, int last, long *population, long *changed,
+                      uint64_t *hash) {
+    GolWorld *world = ctx->world;
+    int width = world->width, height = world->height;
+    const uint8_t *src = world->alive;
+    long row_population = 0, row_changed = 0;
+    uint64_t row_hash = *hash;
+    #pragma omp parallel num_threads(world->num_threads)
+    {
+    RowScratch scratch = create_row_scratch(width);
+    #pragma omp for reduction(+:row_population, row_changed) reduction(^:row_hash)
+    for (int i = first; i < last; i++) {
+        const uint8_t *old_row = src + (size_t)i * width;
+        step_row(ctx, &scratch, i, i > 0 ? old_row - width : ctx->dead_row, old_row,
+                 i + 1 < height ? old_row + width : ctx->dead_row, dst + (size_t)i * width,
+                 &row_population, &row_changed, &row_hash);
+    }
+    flush_pyramid_deltas(ctx, &scratch);
+    free_row_scratch(&scratch);
+    }
+    *population += row_population;
+    *changed += row_changed;
+    *hash = row_hash;
+}
+
+/* Calculates the next generation into the spare buffer and swaps the buffers. */
+static void step_double_buffered(const StepContext *ctx, long *population, long *changed, uint64_t *hash) {
+    GolWorld *world = ctx->world;
+    GolBuffer *next = world->spare != NULL ? world->spare : create_buffer((size_t)world->width * world->height);
+    step_rows(ctx, next->cells, 0, world->height, population, changed, hash);
+    swap_buffers(world, next);
+}
+
+/*
+ * Calculates the next generation in the current buffer. Every thread steps a block of rows from the top
+ * down and keeps only the original of the row above and of the current row in a rolling buffer.
+ * The rows next to a block belong to other threads, their originals are copied before the step.
+**/
+static void step_in_place(const StepContext *ctx, long *population, long *changed, uint64_t *hash) {
+    GolWorld *world = ctx->world;
+    int width = world->width, height = world->height;
+    uint8_t *cells = world->alive;
+    int blocks = world->num_threads < height ? world->num_threads : height;
+    uint8_t *borders = malloc((size_t)2 * blocks * width);  // the rows above and below every block
+    for (int b = 0; b < blocks; b++) {
+        int first = (long)height * b / blocks, last = (long)height * (b + 1) / blocks;
+        uint8_t *above = borders + (size_t)2 * b * width, *below = above + width;
+        memcpy(above, first > 0 ? cells + (size_t)(first - 1) * width : ctx->dead_row, width);
+        memcpy(below, last < height ? cells + (size_t)last * width : ctx->dead_row, width);
+    }
+    long row_population = 0, row_changed = 0;
+    uint64_t row_hash = *hash;
+    #pragma omp parallel for num_threads(blocks) schedule(static, 1) reduction(+:row_population, row_changed) reduction(^:row_hash)
+    for (int b = 0; b < blocks; b++) {
+        RowScratch scratch = create_row_scratch(width);
+        uint8_t *rolling = malloc((size_t)2 * width);
+        uint8_t *previous = rolling, *original = rolling + width;
+        int first = (long)height * b / blocks, last = (long)height * (b + 1) / blocks;
+        const uint8_t *above = borders + (size_t)2 * b * width, *below = above + width;
+        for (int i = first; i < last; i++) {
+            uint8_t *row = cells + (size_t)i * width;
+            memcpy(original, row, width);
+            step_row(ctx, &scratch, i, i == first ? above : previous, original, i + 1 == last ? below : row + width,
+                     row, &row_population, &row_changed, &row_hash);
+            uint8_t *swap = previous;
+            previous = original;
+            original = swap;
+        }
+        free(rolling);
+        flush_pyramid_deltas(ctx, &scratch);
+        free_row_scratch(&scratch);
+    }
+    free(borders);
+    *population = row_population;
+    *changed = row_changed;
+    *hash = row_hash;
+}
+
+/* Fills the context of the next step of the world, free dead_row afterwards. */
+static void init_step_context(GolWorld *world, StepContext *ctx) {
+    *ctx = (StepContext){
+        .world = world,
+        .count_changes = world->heat_mode == HEAT_CHANGES,
+        .birth = world->generation,
+        .mark_changes = true,
+        .dead_row = calloc(world->width, 1),
+    };
+    for (int n = 0; n <= 8; n++) {
+        ctx->next_state[0][n] = world->rule.birth >> n & 1;
+        ctx->next_state[1][n] = world->rule.survive >> n & 1;
+    }
+}
+
+/* Stores the totals of the last of the given count of generations and propagates the pyramid. */
+static void finish_steps(GolWorld *world, int generations, long population, long changed, uint64_t hash) {
+    world->population = population;
+    world->changed = changed;
+    world->hash = hash;
+    world->generation += generations;
+    if (world->check_hash && gol_hash_full(world) != hash)
+        log_error("Hash of generation %ld differs: incremental %016llx, full %016llx", world->generation,
+                  (unsigned long long)hash, (unsigned long long)gol_hash_full(world));
+    if (world->pyramid != NULL) pyramid_propagate(world->pyramid);
+}
+
+/*
+ * Calculates the next generation according to the rule, in place if enabled and the current buffer is
+ * not pinned by a snapshot, otherwise into the spare buffer.
+**/
+static void step_once(GolWorld *world) {
+    StepContext ctx;
+    init_step_context(world, &ctx);
+    long population = 0, changed = 0;
+    uint64_t hash = world->hash;
+    memset(world->dirty_tiles, 0, (size_t)gol_tile_rows(world) * world->change_words);
+    if (world->in_place && __atomic_load_n(&world->current->refs, __ATOMIC_ACQUIRE) == 1) {
+        release_buffer(world->spare);  // not needed in place, half the memory of the cells
+        world->spare = NULL;
+        step_in_place(&ctx, &population, &changed, &hash);
+    }
+    else step_double_buffered(&ctx, &population, &changed, &hash);
+    free(ctx.dead_row);
+    finish_steps(world, 1, population, changed, hash);
+}
+
+void gol_step(GolWorld *world, int generations) {
+    complete_sliced_step(world);
+    for (int n = 0; n < generations; n++)
+        step_once(world);
+}
+
+/*
+ * @struct GolSlice
+ * @brief A started step of gol_step_slice.
+ * @param ctx: the context of the step.
+ * @param next: the buffer of the next generation.
+ * @param row: the next row to calculate.
+ * @param population: the alive cells of the calculated rows.
+ * @param changed: the changed cells of the calculated rows.
+ * @param hash: the hash with the changes of the calculated rows.
+ * The heat and the pyramid are deferred (see StepContext), the level 1 deltas are kept in ctx.
+**/
+struct GolSlice {
+    StepContext ctx;
+    GolBuffer *next;
+    int row;
+    long population;
+    long changed;
+    uint64_t hash;
+};
+
+bool gol_step_slice(GolWorld *world, double budget) {
+    double start = omp_get_wtime();
+    int width = world->width, height = world->height;
+    if (world->slice == NULL) {
+        GolSlice *slice = calloc(1, sizeof(GolSlice));
+        init_step_context(world, &slice->ctx);
+        slice->ctx.deferred = true;
+        if (world->pyramid != NULL && world->pyramid->levels >= 2)
+            slice->ctx.pyramid_deltas = calloc((size_t)world->pyramid->widths[1] * world->pyramid->heights[1],
+                                               sizeof(int32_t));
+        slice->next = world->spare != NULL ? world->spare : create_buffer((size_t)width * height);
+        slice->hash = world->hash;
+        world->spare = NULL;
+        world->slice = slice;
+        memset(world->dirty_tiles, 0, (size_t)gol_tile_rows(world) * world->change_words);
+    }
+    GolSlice *slice = world->slice;
+    // Batches of about SLICE_CELLS cells per thread, the time is checked after every batch
+    int batch = (SLICE_CELLS / width + 1) * world->num_threads;
+    do {
+        int last = height - slice->row > batch ? slice->row + batch : height;
+        step_rows(&slice->ctx, slice->next->cells, slice->row, last, &slice->population, &slice->changed,
+                  &slice->hash);
+        slice->row = last;
+    } while (slice->row < height && omp_get_wtime() - start < budget);
+    if (slice->row < height) return false;
+
+    // The deferred updates, alive still has the old generation
+    if (world->heat != NULL) {
+        #pragma omp parallel for num_threads(world->num_threads)
+        for (int i = 0; i < height; i++)
+            add_heat_row(&slice->ctx, i, world->alive + (size_t)i * width, slice->next->cells + (size_t)i * width);
+    }
+    if (slice->ctx.pyramid_deltas != NULL) {
+        for (int y = 0; y < world->pyramid->heights[1]; y++)
+            pyramid_add_row(world->pyramid, y, slice->ctx.pyramid_deltas + (size_t)y * world->pyramid->widths[1], false);
+    }
+    world->slice = NULL;
+    swap_buffers(world, slice->next);
+    slice->next = NULL;
+    finish_steps(world, 1, slice->population, slice->changed, slice->hash);
+    free_slice(slice);
+    return true;
+}
+
+static void free_slice(GolSlice *slice) {
+    if (slice == NULL) return;
+    release_buffer(slice->next);
+    free(slice->ctx.dead_row);
+    free(slice->ctx.pyramid_deltas);
+    free(slice);
+}
+
+/* Finishes a started sliced step, before the world is written otherwise. */
+static void complete_sliced_step(GolWorld *world) {
+    if (world->slice != NULL) gol_step_slice(world, INFINITY);
+}
+
+/*
+ * @struct TrapezoidWalk
+ * @brief The state of gol_advance shared by all trapezoids.
+ * @param ctx: the context of the first step, the births of later steps are counted up from it.
+ * @param planes: the cells of the even (0) and the odd (1) generations of the walk.
+ * @param generations: the count of generations of the walk.
+ * @param scratch: the row buffers of every thread.
+ * @param population: the count of alive cells of the last generation.
+ * @param changed: the count of cells changed by the last generation.
+ * @param hash: the hash, the keys of the changes of all generations are xored in.
+**/
+typedef struct {
+    const StepContext *ctx;
+    uint8_t *planes[2];
+    int generations;
+    RowScratch *scratch;
+    long population;
+    long changed;
+    uint64_t hash;
+} TrapezoidWalk;
+
+/*
+ * Calculates the rows of generation t + 1 of the walk for every t from t0 to t1 - 1: the rows from
+ * y0 + dy0 * (t - t0) to y1 + dy1 * (t - t0) (exclusive), from the planes of generation t.
+**/
+static void walk_rows(TrapezoidWalk *walk, int t0, int t1, int y0, int dy0, int y1, int dy1) {
+    GolWorld *world = walk->ctx->world;
+    int width = world->width, height = world->height;
+    RowScratch *scratch = &walk->scratch[omp_get_thread_num()];
+    long population = 0, changed = 0;
+    uint64_t hash = 0;
+    for (int t = t0; t < t1; t++) {
+        StepContext ctx = *walk->ctx;
+        ctx.birth += t;
+        ctx.mark_changes = t + 1 == walk->generations;
+        const uint8_t *src = walk->planes[t % 2];
+        uint8_t *dst = walk->planes[(t + 1) % 2];
+        long row_population = 0, row_changed = 0;
+        for (int i = y0 + dy0 * (t - t0); i < y1 + dy1 * (t - t0); i++) {
+            const uint8_t *old_row = src + (size_t)i * width;
+            step_row(&ctx, scratch, i, i > 0 ? old_row - width : ctx.dead_row, old_row,
+                     i + 1 < height ? old_row + width : ctx.dead_row, dst + (size_t)i * width,
+                     &row_population, &row_changed, &hash);
+        }
+        if (ctx.mark_changes) {
+            population += row_population;
+            changed += row_changed;
+        }
+    }
+    flush_pyramid_deltas(walk->ctx, scratch);
+    __atomic_fetch_add(&walk->population, population, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&walk->changed, changed, __ATOMIC_RELAXED);
+    __atomic_fetch_xor(&walk->hash, hash, __ATOMIC_RELAXED);
+}
+
+/*
+ * Calculates the space time trapezoid of the generations t0 + 1 to t1 with the rows from y0 + dy0 * (t - t0)
+ * to y1 + dy1 * (t - t0) (exclusive) at generation t + 1, the slopes dy0 and dy1 are -1, 0 (border) or 1.
+ * A wide trapezoid is cut into two upright ones next to each other, which depend only on the rows below
+ * them and run as parallel tasks, and the inverted one between them, which needs both. A tall one is cut
+ * in time into a lower and an upper half. The pieces get smaller until they fit into every cache level,
+ * without knowing the cache sizes (Frigo and Strumpen, cache oblivious stencil computations).
+**/
+static void walk_trapezoid(TrapezoidWalk *walk, int t0, int t1, int y0, int dy0, int y1, int dy1) {
+    int dt = t1 - t0;
+    long cells = (long)(y1 - y0 + (dy1 - dy0) * dt / 2) * dt * walk->ctx->world->width;
+    if (dt == 1 || cells <= TRAPEZOID_BASE_CELLS) {
+        walk_rows(walk, t0, t1, y0, dy0, y1, dy1);
+        return;
+    }
+    // The middle of the space cut has to leave room for the slopes of both upright pieces
+    int low = y0 + (1 + dy0) * dt, high = y1 + (dy1 - 1) * dt;
+    if (high - low >= 2 * dt) {
+        int middle = low + (high - low) / 2;
+        #pragma omp task if(cells > TRAPEZOID_TASK_CELLS)
+        walk_trapezoid(walk, t0, t1, y0, dy0, middle, -1);
+        #pragma omp task if(cells > TRAPEZOID_TASK_CELLS)
+        walk_trapezoid(walk, t0, t1, middle, 1, y1, dy1);
+        #pragma omp taskwait
+        walk_trapezoid(walk, t0, t1, middle, -1, middle, 1);
+        return;
+    }
+    int half = dt / 2;
+    walk_trapezoid(walk, t0, t0 + half, y0, dy0, y1, dy1);
+    walk_trapezoid(walk, t0 + half, t1, y0 + dy0 * half, dy0, y1 + dy1 * half, dy1);
+}
+
+void gol_advance(GolWorld *world, int generations) {
+    complete_sliced_step(world);
+    if (generations > 0 && __atomic_load_n(&world->current->refs, __ATOMIC_ACQUIRE) > 1) {
+        step_once(world);  // the pinned buffer must not be written, the walk starts in a new one
+        generations--;
+    }
+    if (generations <= 1) {
+        gol_step(world, generations);
+        return;
+    }
+    int width = world->width, height = world->height;
+    StepContext ctx;
+    init_step_context(world, &ctx);
+    GolBuffer *next = world->spare != NULL ? world->spare : create_buffer((size_t)width * height);
+    world->spare = NULL;
+    TrapezoidWalk walk = {
+        .ctx = &ctx,
+        .planes = { world->alive, next->cells },
+        .generations = generations,
+        .scratch = malloc(world->num_threads * sizeof(RowScratch)),
+        .hash = world->hash,
+    };
+    for (int n = 0; n < world->num_threads; n++) walk.scratch[n] = create_row_scratch(width);
+    memset(world->dirty_tiles, 0, (size_t)gol_tile_rows(world) * world->change_words);
+    #pragma omp parallel num_threads(world->num_threads)
+    #pragma omp single
+    walk_trapezoid(&walk, 0, generations, 0, 0, height, 0);
+    for (int n = 0; n < world->num_threads; n++) free_row_scratch(&walk.scratch[n]);
+    free(walk.scratch);
+    free(ctx.dead_row);
+    if (generations % 2 == 1) swap_buffers(world, next);
+    else world->spare = next;
+    finish_steps(world, generations, walk.population, walk.changed, walk.hash);
+}
+
+bool gol_get(const GolWorld *world, int x, int y) {
+    if (x < 0 || y < 0 || x >= world->width || y >= world->height) return false;
+    return world->alive[(size_t)y * world->width + x];
+}
+
+uint8_t *gol_cells(GolWorld *world) {
+    complete_sliced_step(world);
+    if (__atomic_load_n(&world->current->refs, __ATOMIC_ACQUIRE) > 1) {
+        // Copy on write, the snapshot keeps the old cells
+        GolBuffer *copy = world->spare != NULL ? world->spare : create_buffer((size_t)world->width * world->height);
+        memcpy(copy->cells, world->alive, (size_t)world->width * world->height);
+        swap_buffers(world, copy);
+    }
+    return world->alive;
+}
+
+/*
+ * Sets one cell of the writable cells and keeps the population and the density pyramid up to date,
+ * the pyramid has to be propagated afterwards.
+**/
+static void set_cell(GolWorld *world, uint8_t *cells, int x, int y, bool alive) {
+    size_t index = (size_t)y * world->width + x;
+    if (cells[index] == alive) return;
+    cells[index] = alive;
+    world->births[index] = world->generation;
+    world->population += alive ? 1 : -1;
+    uint64_t *word = &world->changes[(size_t)y * world->change_words + x / 64];
+    if (!(*word >> (x % 64) & 1)) world->changed++;
+    world->hash ^= cell_key(index);
+    *word |= 1ULL << (x % 64);
+    world->dirty_tiles[(size_t)(y / GOL_TILE_ROWS) * world->change_words + x / 64] = 1;
+    if (world->pyramid != NULL) pyramid_add(world->pyramid, y, x, alive ? 1 : -1);
+}
+
+void gol_set(GolWorld *world, int x, int y, bool alive) {
+    if (x < 0 || y < 0 || x >= world->width || y >= world->height) return;
+    set_cell(world, gol_cells(world), x, y, alive);
+    if (world->pyramid != NULL) pyramid_propagate(world->pyramid);
+}
+
+void gol_copy_region(const GolWorld *world, int x, int y, int w, int h, unsigned char *out) {
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < w; j++)
+            *out++ = gol_get(world, x + j, y + i);
+    }
+}
+
+void gol_set_region(GolWorld *world, int x, int y, int w, int h, const unsigned char *in) {
+    uint8_t *cells = gol_cells(world);
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < w; j++, in++) {
+            if (x + j < 0 || y + i < 0 || x + j >= world->width || y + i >= world->height) continue;
+            set_cell(world, cells, x + j, y + i, *in != 0);
+        }
+    }
+    if (world->pyramid != NULL) pyramid_propagate(world->pyramid);
+}
+
+GolView gol_view(const GolWorld *world) {
+    return (GolView){ .cells = world->alive, .width = world->width, .height = world->height,
+                      .generation = world->generation };
+}
+
+bool gol_view_valid(const GolWorld *world, const GolView *view) {
+    return view->cells == world->alive && view->generation == world->generation;
+}
+
+GolSnapshot gol_snapshot(GolWorld *world) {
+    __atomic_add_fetch(&world->current->refs, 1, __ATOMIC_RELAXED);
+    return (GolSnapshot){ .cells = world->alive, .width = world->width, .height = world->height,
+                          .generation = world->generation, .buffer = world->current };
+}
+
+void gol_snapshot_release(GolSnapshot *snapshot) {
+    release_buffer(snapshot->buffer);
+    *snapshot = (GolSnapshot){ 0 };
+}
+
+/* Sets the births of count cells starting at births to the current generation (age 0). */
+static void stamp_births(const GolWorld *world, uint32_t *births, size_t count) {
+    uint32_t birth = world->generation;
+    for (size_t i = 0; i < count; i++)
+        births[i] = birth;
+}
+
+void gol_clear(GolWorld *world) {
+    size_t count = (size_t)world->width * world->height;
+    memset(gol_cells(world), 0, count);
+    stamp_births(world, world->births, count);  // cells written afterwards with gol_cells are new
+    gol_recount(world);
+}
+
+/*
+ * Writes the 64 bits of mask as 64 cells (bit k -> cells[k]), count <= 64 cells are written.
+**/
+static void write_mask(uint8_t *cells, uint64_t mask, size_t count) {
+    for (size_t k = 0; k < count; k += 8, mask >>= 8) {
+        // Every byte gets a copy of the 8 bits and keeps only its own bit, which is then moved to bit 0
+        uint64_t bytes = ((mask & 0xff) * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+        bytes = ((bytes + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL;
+        memcpy(cells + k, &bytes, count - k < 8 ? count - k : 8);
+    }
+}
+
+void gol_fill_random(GolWorld *world, double density, uint64_t seed) {
+    size_t count = (size_t)world->width * world->height;
+    uint8_t *cells = gol_cells(world);
+
+    // The density as a 16 bit fraction. Every random word has the probability 1/2 per bit,
+    // combining one word per bit of the fraction (from the lowest set bit up) gives the density:
+    // a 1 bit ors the next word in (p = 1/2 + p/2), a 0 bit ands it (p = p/2).
+    long fraction = lround(density * (1 << FILL_DENSITY_BITS));
+    if (fraction < 0) fraction = 0;
+    int lowest_bit = fraction == 0 ? FILL_DENSITY_BITS : __builtin_ctzl(fraction);
+    bool all_alive = fraction >= 1 << FILL_DENSITY_BITS;
+
+    size_t words = (count + 63) / 64;
+    long chunks = (words + FILL_CHUNK_WORDS - 1) / FILL_CHUNK_WORDS;
+    long population = 0;
+    #pragma omp parallel for num_threads(world->num_threads) schedule(static) reduction(+:population)
+    for (long chunk = 0; chunk < chunks; chunk++) {
+        // An own stream per chunk, so the cells do not depend on the count of threads
+        uint64_t state = chunk;
+        state = next_random(&state) ^ seed;
+        size_t first_word = (size_t)chunk * FILL_CHUNK_WORDS;
+        size_t last_word = first_word + FILL_CHUNK_WORDS < words ? first_word + FILL_CHUNK_WORDS : words;
+        for (size_t word = first_word; word < last_word; word++) {
+            uint64_t mask = all_alive ? UINT64_MAX : 0;
+            if (!all_alive) {
+                for (int bit = lowest_bit; bit < FILL_DENSITY_BITS; bit++) {
+                    uint64_t r = next_random(&state);
+                    mask = fraction >> bit & 1 ? mask | r : mask & r;
+                }
+            }
+            size_t cell_count = count - word * 64 < 64 ? count - word * 64 : 64;
+            if (cell_count < 64) mask &= (1ULL << cell_count) - 1;
+            write_mask(cells + word * 64, mask, cell_count);
+            stamp_births(world, world->births + word * 64, cell_count);
+            population += __builtin_popcountll(mask);
+        }
+    }
+    world->population = population;
+    world->hash = gol_hash_full(world);
+    mark_all_changed(world);
+    if (world->pyramid != NULL) gol_enable_pyramid(world, true);
+}
+
+size_t gol_memory_size(int width, int height, bool in_place, bool heat) {
+    size_t count = (size_t)width * height;
+    size_t words = (size_t)height * ((width + 63) / 64);
+    return sizeof(GolWorld) + (in_place ? 1 : 2) * (sizeof(GolBuffer) + count) + count * sizeof(uint32_t)
+           + (heat ? count * sizeof(uint16_t) : 0) + words * sizeof(uint64_t) + words / GOL_TILE_ROWS + 1;
+}
+
+bool gol_resize(GolWorld *world, int width, int height) {
+    if (width < 1 || height < 1) {
+        log_error("Invalid world size %dx%d", width, height);
+        return false;
+    }
+    complete_sliced_step(world);
+    // New planes, the cells in both sizes are copied row by row
+    size_t count = (size_t)width * height;
+    GolBuffer *buffer = create_buffer(count);
+    uint32_t *births = malloc(count * sizeof(uint32_t));
+    stamp_births(world, births, count);  // new cells are born now
+    uint16_t *heat = world->heat != NULL ? calloc(count, sizeof(uint16_t)) : NULL;
+    int copy_width = width < world->width ? width : world->width;
+    int copy_height = height < world->height ? height : world->height;
+    for (int i = 0; i < copy_height; i++) {
+        size_t from = (size_t)i * world->width, to = (size_t)i * width;
+        memcpy(buffer->cells + to, world->alive + from, copy_width);
+        memcpy(births + to, world->births + from, copy_width * sizeof(uint32_t));
+        if (heat != NULL) memcpy(heat + to, world->heat + from, copy_width * sizeof(uint16_t));
+    }
+    release_buffer(world->current);
+    release_buffer(world->spare);
+    free(world->births);
+    free(world->heat);
+    world->current = buffer;
+    world->spare = NULL;
+    world->alive = buffer->cells;
+    world->births = births;
+    world->heat = heat;
+    world->width = width;
+    world->height = height;
+    free(world->changes);
+    free(world->dirty_tiles);
+    create_change_planes(world);
+    gol_recount(world);  // also builds the pyramid for the new size and marks all cells as changed
+    return true;
+}
+
+void gol_reset_heat(GolWorld *world) {
+    complete_sliced_step(world);
+    if (world->heat != NULL) memset(world->heat, 0, (size_t)world->width * world->height * sizeof(uint16_t));
+}
+
+void gol_enable_heat(GolWorld *world, bool enable) {
+    if ((world->heat != NULL) == enable) return;
+    complete_sliced_step(world);
+    free(world->heat);
+    world->heat = enable ? calloc((size_t)world->width * world->height, sizeof(uint16_t)) : NULL;
+}
+
+void gol_enable_pyramid(GolWorld *world, bool enable) {
+    complete_sliced_step(world);
+    free_density_pyramid(world->pyramid);
+    world->pyramid = NULL;
+    if (!enable) return;
+    world->pyramid = create_density_pyramid(world->width, world->height);
+    for (int i = 0; i < world->height; i++)
+        for (int j = 0; j < world->width; j++)
+            if (world->alive[(size_t)i * world->width + j]) pyramid_add(world->pyramid, i, j, 1);
+    pyramid_propagate(world->pyramid);
+}
+
+uint64_t gol_hash_full(const GolWorld *world) {
+    uint64_t hash = 0;
+    size_t count = (size_t)world->width * world->height;
+    #pragma omp parallel for num_threads(world->num_threads) schedule(static) reduction(^:hash)
+    for (size_t i = 0; i < count; i++)
+        if (world->alive[i]) hash ^= cell_key(i);
+    return hash;
+}
+
+void gol_recount(GolWorld *world) {
+    complete_sliced_step(world);
+    long population = 0;
+    size_t count = (size_t)world->width * world->height;
+    for (size_t i = 0; i < count; i++)
+        population += world->alive[i];
+    world->population = population;
+    world->hash = gol_hash_full(world);
+    mark_all_changed(world);
+    if (world->pyramid != NULL) gol_enable_pyramid(world, true);
+}
@@ -0,0 +1,234 @@
+#ifndef GOL_H
+#define GOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rule.h"
+#include "pyramid.h"
+
+/*
+ * libgol: the simulation without any terminal code, built as libgol.a and libgol.so.
+ * The ncurses frontend (main.c) uses it like any other program.
+**/
+
+#define GOL_TILE_ROWS 64  // rows of a tile of dirty_tiles, a tile is one word (64 columns) of changes wide
+
+/*
+ * What the activity counters count per generation.
+**/
+typedef enum {
+    HEAT_CHANGES,  /* the cell changed its state */
+    HEAT_ALIVE  /* the cell is alive */
+} HeatMode;
+
+/* A cell buffer with a reference count, shared by the world and its snapshots. */
+typedef struct GolBuffer GolBuffer;
+/* The state of a started step of gol_step_slice. */
+typedef struct GolSlice GolSlice;
+
+/*
+ * @struct GolWorld
+ * @brief The cells and the settings of one simulation.
+ *        All planes have one entry per cell, row by row (index y * width + x).
+ *        The step writes the next generation into a second buffer and swaps both, or with in_place
+ *        into the current buffer.
+ * @param width: the count of the columns.
+ * @param height: the count of the rows.
+ * @param alive: the cells of the current generation (1 = alive), read only, write with gol_set or gol_cells.
+ * @param births: the generation in which every cell was born (see gol_age), only written on births.
+ * @param heat: the activity counter of every cell (saturating), NULL until enabled with gol_enable_heat.
+ * @param heat_mode: what the activity counters count.
+ * @param pyramid: the density pyramid, only kept up to date if enabled with gol_enable_pyramid.
+ * @param rule: the birth/survive rule of the next steps.
+ * @param num_threads: the number of threads of the next steps.
+ * @param in_place: if true, the steps write into the current buffer and keep only two original rows per
+ *                  thread, half the memory of the cells. A buffer pinned by a snapshot is not changed,
+ *                  that step writes into a new buffer.
+ * @param generation: the count of the steps since the creation.
+ * @param population: the count of the alive cells.
+ * @param current: the buffer of alive.
+ * @param spare: the buffer for the next generation, NULL if it has to be allocated.
+ * @param changes: one bit per cell that changed in the last step, row by row with change_words words per
+ *                 row (bit j % 64 of word j / 64 is column j). All bits are set after other writes.
+ * @param change_words: the count of words of changes per row.
+ * @param dirty_tiles: one flag per tile of GOL_TILE_ROWS x 64 cells with a change in the last step,
+ *                     row by row with change_words tiles per row. All are set after other writes.
+ * @param changed: the count of cells that changed in the last step.
+ * @param hash: the Zobrist hash of the cells, the xor of a random key per alive cell (see gol_hash).
+ * @param check_hash: if true, every step compares hash with a full recompute and logs differences (slow).
+ * @param slice: the started step of gol_step_slice, NULL if none.
+**/
+typedef struct {
+    int width;
+    int height;
+    uint8_t *alive;
+    uint32_t *births;
+    uint16_t *heat;
+    HeatMode heat_mode;
+    DensityPyramid *pyramid;
+    Rule rule;
+    int num_threads;
+    bool in_place;
+    long generation;
+    long population;
+    GolBuffer *current;
+    GolBuffer *spare;
+    uint64_t *changes;
+    int change_words;
+    uint8_t *dirty_tiles;
+    long changed;
+    uint64_t hash;
+    bool check_hash;
+    GolSlice *slice;
+} GolWorld;
+
+/*
+ * @struct GolView
+ * @brief A read only view of the cells of one generation without a copy.
+ *        It is valid until the next step, resize or clear of the world (see gol_view_valid).
+ * @param cells: the cells (1 = alive), row by row.
+ * @param width: the count of the columns.
+ * @param height: the count of the rows.
+ * @param generation: the generation of the cells.
+**/
+typedef struct {
+    const uint8_t *cells;
+    int width;
+    int height;
+    long generation;
+} GolView;
+
+/*
+ * @struct GolSnapshot
+ * @brief The cells of one generation, kept alive by a reference count until gol_snapshot_release.
+ *        The world continues in other buffers, so a snapshot never has to be copied.
+ * @param cells: the cells (1 = alive), row by row.
+ * @param width: the count of the columns.
+ * @param height: the count of the rows.
+ * @param generation: the generation of the cells.
+ * @param buffer: the pinned buffer.
+**/
+typedef struct {
+    const uint8_t *cells;
+    int width;
+    int height;
+    long generation;
+    GolBuffer *buffer;
+} GolSnapshot;
+
+/* Creates a world of width x height dead cells with the rule, returns NULL for an invalid size. */
+GolWorld *gol_create(int width, int height, const Rule *rule);
+/* Frees the world, its snapshots stay valid until they are released. */
+void gol_free(GolWorld *world);
+/* Calculates the next generations, the given count of generations in a row. */
+void gol_step(GolWorld *world, int generations);
+/*
+ * Calculates rows of the next generation for about budget seconds and continues there at the next call.
+ * The rows are written into the second buffer (never in place), so alive, views and snapshots show the
+ * complete current generation until the last row is done and the buffers are swapped. The heat and the
+ * pyramid are updated at the swap as well, only the births of dead cells already contain the calculated rows.
+ * All other functions that change the world (gol_step, gol_set, gol_cells, gol_resize, ...) finish a
+ * started step first.
+ * @return true if the generation was finished by this call.
+**/
+bool gol_step_slice(GolWorld *world, double budget);
+/*
+ * Calculates the given count of generations in a row like gol_step, with the same cells, births, heat and
+ * hash, but walks the generations in space time trapezoids: a few rows are stepped many generations ahead
+ * while they are in the cache, instead of every generation passing over the whole grid. The trapezoids
+ * are calculated in parallel tasks with num_threads. The intermediate generations are never complete, so
+ * use it when they are not needed. Always uses two buffers (ignores in_place).
+**/
+void gol_advance(GolWorld *world, int generations);
+
+/* Returns true if the cell at column x, row y is alive, false outside of the world. */
+bool gol_get(const GolWorld *world, int x, int y);
+/* Sets the cell at column x, row y alive or dead, cells outside of the world are ignored. */
+void gol_set(GolWorld *world, int x, int y, bool alive);
+/*
+ * Copies the w x h cells starting at column x, row y into out (one byte per cell, 1 = alive, row by row).
+ * Cells outside of the world are copied as dead.
+**/
+void gol_copy_region(const GolWorld *world, int x, int y, int w, int h, unsigned char *out);
+/*
+ * Sets the w x h cells starting at column x, row y from in (one byte per cell, non zero = alive, row by row).
+ * Cells outside of the world are ignored.
+**/
+void gol_set_region(GolWorld *world, int x, int y, int w, int h, const unsigned char *in);
+/*
+ * Returns the cells of the current generation for writing many cells at once (1 = alive, 0 = dead).
+ * Call gol_recount afterwards. A buffer pinned by a snapshot is copied first.
+ * Cells set alive here have the age 0 after gol_clear or gol_resize, otherwise the age of their last birth.
+**/
+uint8_t *gol_cells(GolWorld *world);
+
+/*
+ * Returns the count of the generations the cell at index (y * width + x) is alive, 0 for dead cells.
+ * The births wrap around after 2^32 generations, the difference stays right for younger cells.
+**/
+static inline int gol_age(const GolWorld *world, size_t index) {
+    if (!world->alive[index]) return 0;
+    uint32_t age = (uint32_t)world->generation - world->births[index];
+    return age > INT32_MAX ? INT32_MAX : (int)age;
+}
+
+/* Returns the count of the rows of tiles of dirty_tiles. */
+static inline int gol_tile_rows(const GolWorld *world) {
+    return (world->height + GOL_TILE_ROWS - 1) / GOL_TILE_ROWS;
+}
+
+/* Returns a view of the current generation without a copy. */
+GolView gol_view(const GolWorld *world);
+/* Returns true if the view still shows the current generation of the world. */
+bool gol_view_valid(const GolWorld *world, const GolView *view);
+/* Pins the current generation, it is not changed by the world until the snapshot is released. */
+GolSnapshot gol_snapshot(GolWorld *world);
+/* Releases a snapshot, can be called from any thread. */
+void gol_snapshot_release(GolSnapshot *snapshot);
+
+/*
+ * Returns the hash of the current generation: the xor of a fixed random key of every alive cell.
+ * The step only xors the keys of the changed cells, so it costs no extra pass over the grid.
+ * The same cells in a world of the same width give the same hash.
+**/
+static inline uint64_t gol_hash(const GolWorld *world) {
+    return world->hash;
+}
+/* Calculates the hash of the current generation from all cells, in parallel with num_threads. */
+uint64_t gol_hash_full(const GolWorld *world);
+
+/* Sets all cells dead. */
+void gol_clear(GolWorld *world);
+/*
+ * Sets every cell alive with the probability density (in steps of 1/65536), in parallel with num_threads.
+ * The same seed gives the same cells for any count of threads.
+**/
+void gol_fill_random(GolWorld *world, double density, uint64_t seed);
+/*
+ * Returns the bytes a world of width x height cells needs (without the density pyramid), stepped in place
+ * or not, with or without the activity counters.
+**/
+size_t gol_memory_size(int width, int height, bool in_place, bool heat);
+/*
+ * Changes the size of the world, the cells in both sizes are kept, new cells are dead.
+ * Returns false for an invalid size.
+**/
+bool gol_resize(GolWorld *world, int width, int height);
+/* Sets all activity counters to 0, if enabled. */
+void gol_reset_heat(GolWorld *world);
+/*
+ * Allocates the activity counters (all 0, counted by the steps) or frees them. Without them a step
+ * writes no counter per cell, 2 bytes per cell less memory and traffic.
+**/
+void gol_enable_heat(GolWorld *world, bool enable);
+/* Builds the density pyramid (kept up to date by the steps) or frees it. */
+void gol_enable_pyramid(GolWorld *world, bool enable);
+/*
+ * Counts the alive cells, calculates the hash, builds the pyramid (if enabled) again and marks all cells
+ * as changed, needed after the cells were written directly.
+**/
+void gol_recount(GolWorld *world);
+
+#endif /* GOL_H */
@@ -3,14 +3,46 @@
 #include <unistd.h>
 #include <locale.h>
 #include <omp.h>
+#include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <pty.h>
+#include <sys/ioctl.h>
 
 #define DELAY 15000
+#define ADAPT_DEGRADE_FRAMES 5  // frames over the latency target before the render level is lowered
+#define ADAPT_UPGRADE_FRAMES 60  // frames with enough bandwidth before the render level is raised
+#define DEFAULT_CELL_WIDTH_PX 8  // size of a character cell if the terminal does not report pixels
+#define DEFAULT_CELL_HEIGHT_PX 16
+#define TILE_HISTORY 30  // steps of dirty tiles kept, a cell changes its color class up to 29 steps after its birth
+
+// Palette of the images: 0 is the background, 1-4 are the color classes of get_cell_color_class,
+// 5 is without colors, 6-9 are the heat classes 1-4 of get_heat_class
+static const unsigned char CELL_PALETTE[][3] = {
+    { 0, 0, 0 }, { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 0 }, { 255, 255, 255 },
+    { 0, 0, 160 }, { 0, 200, 200 }, { 255, 200, 0 }, { 255, 40, 0 }
+};
+#define CELL_PALETTE_SIZE 10
+#define HEAT_PALETTE_OFFSET 5
 
 #define CHAR_LOWER_HALF "▄"
 #define CHAR_UPPER_HALF "▀"
 #define CHAR_FULL_BLOCK "█"
+#define CHAR_LIGHT_SHADE "░"
+#define CHAR_MEDIUM_SHADE "▒"
+#define CHAR_DARK_SHADE "▓"
 #define ALIVE_STRING "██"
 #include "logger.h"
+#include "rule.h"
+#include "control.h"
+#include "timing.h"
+#include "record.h"
+#include "sixel.h"
+#include "export.h"
+#include "gol.h"
+#include "rle.h"
+#include "autotune.h"
+#include "tty_count.h"
 
 
 /*
@@ -22,6 +54,34 @@
  * @param show_info: if true, show the info box at bottom.
  * @param show_history: if true, show the history in the info box.
  * @param info_box_height: the height of the info-box at the bottom.
+ * @param rule: the birth/survive rule used to update the cells.
+ * @param num_threads: the number of threads used to update the cells.
+ * @param control_socket: the path of the control socket, NULL if disabled.
+ * @param seed: the seed of the random number generator.
+ * @param headless: if true, run without a terminal, the size is given by term_lines and term_cols.
+ * @param term_lines: the lines of the virtual terminal in headless mode.
+ * @param term_cols: the columns of the virtual terminal in headless mode.
+ * @param max_generations: stop after this many generations, 0 runs until quit.
+ * @param record_path: the file to record the input to, NULL if disabled.
+ * @param replay_path: the file to replay the input from, NULL if disabled.
+ * @param timings_path: the file to write the frame times to (csv), NULL if disabled.
+ * @param bench_render: if true, run the render benchmark instead of the game.
+ * @param latency_target: the max render time per frame in seconds, 0 disables the adaptive rendering.
+ * @param use_graphics: if true, draw one pixel per cell with sixel graphics.
+ * @param export_dir: the directory to export frames to ("-" for stdout), NULL if disabled.
+ * @param export_format: the image format of the exported frames.
+ * @param export_every: export every n-th generation.
+ * @param show_heatmap: if true, draw the activity heatmap instead of the cells.
+ * @param heat_mode: what the activity heatmap counts.
+ * @param count_heat: if true, the activity is counted from the start (--heatmap), otherwise only while shown.
+ * @param world_width: the width of a fixed world in cells, 0 uses the size of the terminal.
+ * @param world_height: the height of a fixed world in cells, 0 uses the size of the terminal.
+ * @param density: the probability of a random cell to be alive at the start and after a reset.
+ * @param check_hash: if true, every step compares the incremental hash with a full recompute.
+ * @param in_place: if true, the cells are stepped in place without a second buffer.
+ * @param step_budget: the max calculation time per frame in seconds, a longer step continues in the next frames, 0 = off.
+ * @param autotune: if true, num_threads and in_place are chosen by benchmarks at the start (cached).
+ * @param fixed_threads: true if num_threads was set with --threads, autotune keeps it.
 */
 typedef struct { 
     bool pause;  /* @brief if true, the game will not be updated.*/
@@ -30,19 +90,36 @@ typedef struct {
     bool show_info;  /* @brief if true, show the info box at bottom. */
     bool show_history;  /* @brief if true, show the history in the info box. */
     int info_box_height;  /* @brief the height of the info-box at the bottom. */
+    Rule rule;  /* @brief the birth/survive rule used to update the cells. */
+    int num_threads;  /* @brief the number of threads used to update the cells. */
+    char *control_socket;  /* @brief the path of the control socket, NULL if disabled. */
+    unsigned int seed;  /* @brief the seed of the random number generator. */
+    bool headless;  /* @brief if true, run without a terminal, the size is given by term_lines and term_cols. */
+    int term_lines;  /* @brief the lines of the virtual terminal in headless mode. */
+    int term_cols;  /* @brief the columns of the virtual terminal in headless mode. */
+    int max_generations;  /* @brief stop after this many generations, 0 runs until quit. */
+    char *record_path;  /* @brief the file to record the input to, NULL if disabled. */
+    char *replay_path;  /* @brief the file to replay the input from, NULL if disabled. */
+    char *timings_path;  /* @brief the file to write the frame times to (csv), NULL if disabled. */
+    bool bench_render;  /* @brief if true, run the render benchmark instead of the game. */
+    double latency_target;  /* @brief the max render time per frame in seconds, 0 disables the adaptive rendering. */
+    bool use_graphics;  /* @brief if true, draw one pixel per cell with sixel graphics. */
+    char *export_dir;  /* @brief the directory to export frames to ("-" for stdout), NULL if disabled. */
+    ExportFormat export_format;  /* @brief the image format of the exported frames. */
+    int export_every;  /* @brief export every n-th generation. */
+    bool show_heatmap;  /* @brief if true, draw the activity heatmap instead of the cells. */
+    HeatMode heat_mode;  /* @brief what the activity heatmap counts. */
+    bool count_heat;  /* @brief if true, the activity is counted from the start (--heatmap), otherwise only while shown. */
+    int world_width;  /* @brief the width of a fixed world in cells, 0 uses the size of the terminal. */
+    int world_height;  /* @brief the height of a fixed world in cells, 0 uses the size of the terminal. */
+    double density;  /* @brief the probability of a random cell to be alive at the start and after a reset. */
+    bool check_hash;  /* @brief if true, every step compares the incremental hash with a full recompute. */
+    bool in_place;  /* @brief if true, the cells are stepped in place without a second buffer. */
+    double step_budget;  /* @brief the max calculation time per frame in seconds, a longer step continues in the next frames, 0 = off. */
+    bool autotune;  /* @brief if true, num_threads and in_place are chosen by benchmarks at the start (cached). */
+    bool fixed_threads;  /* @brief true if num_threads was set with --threads, autotune keeps it. */
 } Settings;
 
-/*
- * @struct Cell
-    * @brief A cell of the game.
-* @param alive: if true, the cell is alive.
-* @param alive_for_iterations: the count of the iterations the cell is alive.
-**/
-typedef struct {
-    bool alive;  /* if true, the cell is alive. */
-    int alive_for_iterations;  /* the count of the iterations the cell is alive. */
-} Cell;
-
 /*
  * @struct History
  * @brief The history of the game.
@@ -64,12 +141,44 @@ typedef struct History {
     void (*free_history)(struct History*); /* @brief Pointer to the free function. */
 } History;
 
+/*
+ * The render levels of the adaptive rendering, every level sends less to the terminal.
+**/
+typedef enum {
+    RENDER_FULL,  /* everything as set by the user */
+    RENDER_NO_COLORS,  /* no colors */
+    RENDER_TWO_CELLS,  /* no colors, two cells per block (only drawn so, the grid stays) */
+    RENDER_SKIP_HALF,  /* like above, only every 2nd frame is drawn */
+    RENDER_SKIP_MOST,  /* like above, only every 4th frame is drawn */
+    RENDER_LEVEL_COUNT
+} RenderLevel;
+
+/*
+ * @struct AdaptiveRender
+ * @brief The state of the adaptive rendering, which measures the render time and the bytes sent
+ *        to the terminal and changes the render level to stay within the latency target.
+ * @param level: the current render level.
+ * @param avg_time: the moving average of the render time per drawn frame.
+ * @param throughput: the moving average of the bytes per second the terminal accepts.
+ * @param level_bytes: the moving average of the bytes per frame of every level, 0 if unknown.
+ * @param frames_over: the count of consecutive frames over the latency target.
+ * @param frames_under: the count of consecutive frames where the higher level would fit.
+**/
+typedef struct {
+    RenderLevel level;
+    double avg_time;
+    double throughput;
+    double level_bytes[RENDER_LEVEL_COUNT];
+    int frames_over;
+    int frames_under;
+} AdaptiveRender;
+
 /*
  * @struct GameOfLife
     * @brief The game of life.
 * @param game_window: The window of the game.
 * @param info_box: The info box at the bottom.
-* @param cells: The cells of the game.
+* @param world: The cells of the game (libgol).
 * @param settings: The settings of the game.
 * @param history: The history of the game.
 * @param width: The width of the game window.
@@ -77,23 +186,53 @@ typedef struct History {
 * @param last_calc_time: The last calculation time.
 * @param count_circles: The count of the cicles.
 * @param avg_calc_time: The average calculation time.
+* @param pending_steps: The count of generations to calculate while paused.
+* @param term_lines: The lines of the terminal the size was calculated from.
+* @param term_cols: The columns of the terminal the size was calculated from.
+* @param frame: The count of the main loop iterations.
+* @param recording: The input recording or replay, NULL if disabled.
+* @param render: The state of the adaptive rendering.
+* @param sixel: The image of the graphics mode, NULL if not used yet.
+* @param cell_height_px: The height of a character cell in pixels, 0 if unknown.
+* @param zoom: The zoom level, a character shows 2^zoom x 2^zoom cells (0 = one cell).
+* @param view_x: The first column of the world that is shown.
+* @param view_y: The first row of the world that is shown.
+* @param field_valid: The game window shows the cells of the last drawn frame, only redraw_tiles have to be drawn.
+* @param redraw_tiles: The tiles of the world (see GolWorld.dirty_tiles) to draw again at the next frame.
+* @param tile_history: The dirty tiles of the last TILE_HISTORY steps, by generation % TILE_HISTORY.
+* @param last_generation: The generation of the world after the last finished update_cells.
 **/
 typedef struct GameOfLife{
     WINDOW *game_window;
     WINDOW *info_box;
-    Cell **cells;
+    GolWorld *world;
     Settings *settings;
     History *history;
     int width;
     int height;
     double last_calc_time;
-    int count_circles;
+    long count_circles;
     double avg_calc_time;
+    int pending_steps;
+    int term_lines;
+    int term_cols;
+    long frame;
+    Recording *recording;
+    AdaptiveRender render;
+    SixelImage *sixel;
+    int cell_height_px;
+    int zoom;
+    int view_x;
+    int view_y;
+    bool field_valid;
+    uint8_t *redraw_tiles;
+    uint8_t *tile_history;
+    long last_generation;
 
     // Functions:
     void (*update_game_x_y)(struct GameOfLife*);  /* @brief Updates the width and height of the game window. */
     void (*free_game)(struct GameOfLife*);  /* @brief Frees the game. */
-    void (*update_cells)(struct GameOfLife*);  /* @brief Updates the cells of the game. */
+    bool (*update_cells)(struct GameOfLife*);  /* @brief Updates the cells of the game, returns true if a generation was finished. */
     void (*handle_resize)(struct GameOfLife*);  /* @brief Handles the resize of the game window. */
     void (*draw_game_field)(struct GameOfLife*);  /* @brief Draws the game field. */
     void (*draw_info_box)(struct GameOfLife*);  /* @brief Draws the info box. */
@@ -107,15 +246,38 @@ typedef struct GameOfLife{
 **/
 void update_game_x_y(GameOfLife *game) {
     if (game == NULL) return;
-    getmaxyx(stdscr, game->height, game->width);  // Update the height and width of the game window
-    wresize(game->game_window, game->height, game->width);
-    wresize(game->info_box, game->settings->info_box_height, game->width);
-    mvwin(game->info_box, game->height - game->settings->info_box_height, 0);
-
-    if (game->settings->use_two_cells_per_block == true)
+    if (game->settings->headless) {
+        game->height = game->settings->term_lines;
+        game->width = game->settings->term_cols;
+    }
+    else {
+        getmaxyx(stdscr, game->height, game->width);  // Update the height and width of the game window
+        wresize(game->game_window, game->height, game->width);
+        wresize(game->info_box, game->settings->info_box_height, game->width);
+        mvwin(game->info_box, game->height - game->settings->info_box_height, 0);
+    }
+    game->term_lines = game->height;
+    game->term_cols = game->width;
+
+    if (game->settings->use_graphics && !game->settings->headless) {
+        // One cell per pixel, the pixel size of the terminal is reported by TIOCGWINSZ (if supported)
+        struct winsize size = { 0 };
+        ioctl(STDOUT_FILENO, TIOCGWINSZ, &size);
+        bool known = size.ws_xpixel > 0 && size.ws_ypixel > 0 && size.ws_col > 0 && size.ws_row > 0;
+        game->cell_height_px = known ? size.ws_ypixel / size.ws_row : 0;
+        game->width *= known ? size.ws_xpixel / size.ws_col : DEFAULT_CELL_WIDTH_PX;
+        game->height *= known ? game->cell_height_px : DEFAULT_CELL_HEIGHT_PX;
+    }
+    else if (game->settings->use_two_cells_per_block == true)
         game->height *= 2;
     else
         game->width /= 2;
+
+    if (game->settings->world_width > 0) {
+        // A fixed world, the terminal only shows a part of it
+        game->width = game->settings->world_width;
+        game->height = game->settings->world_height;
+    }
 }
 
 /*
@@ -155,6 +317,29 @@ History* create_history(int size) {
  * - [-nc]: No colors will be used.
  * - [-nh]: Do not show history.
  * - [-ni]: Do not show info at start.
+ * - [--rule RULE]: The rule to use, e.g. B3/S23.
+ * - [--threads N]: The number of threads used to update the cells.
+ * - [--control PATH]: Listen for commands on the unix socket at PATH.
+ * - [--seed N]: The seed of the random number generator.
+ * - [--density D]: The probability of a random cell to be alive (0-1).
+ * - [--headless]: Run without a terminal.
+ * - [--term COLSxLINES]: The size of the virtual terminal in headless mode.
+ * - [--generations N]: Stop after N generations.
+ * - [--record FILE]: Record keys and resizes to FILE.
+ * - [--replay FILE]: Replay keys and resizes from FILE as fast as possible.
+ * - [--timings FILE]: Write the time of every frame to FILE (csv).
+ * - [--bench-render]: Benchmark the rendering into a pseudo-terminal.
+ * - [--latency-target MS]: Max render time per frame before the rendering is degraded, 0 disables it.
+ * - [-g]: Draw one pixel per cell with sixel graphics.
+ * - [--export-frames DIR]: Export frames as images to DIR, "-" writes raw rgb frames to stdout.
+ * - [--export-format png|ppm]: The image format of the exported frames.
+ * - [--every N]: Export every n-th generation.
+ * - [--heatmap changes|alive]: What the activity heatmap counts.
+ * - [--world WxH]: A fixed world of W x H cells instead of the size of the terminal.
+ * - [--check-hash]: Compare the incremental hash with a full recompute every generation (debug).
+ * - [--in-place]: Step the cells in place, half the memory of the cells for huge worlds.
+ * - [--step-budget MS]: Max calculation time per frame, longer generations are finished in the next frames.
+ * - [--autotune]: Choose the threads and the in place stepping by benchmarks, cached per cpu and world size.
  * - [-h]: Show the help.
  * @param argc: the number of arguments.
  * @param argv: the arguments.
@@ -168,19 +353,136 @@ Settings* create_settings(int argc, char *argv[]) {
     settings->show_history = true;
     settings->show_info = true;
     settings->info_box_height = 10;
+    settings->rule = default_rule();
+    settings->num_threads = 1;
+    settings->seed = 1;  // the seed rand() uses without srand()
+    settings->term_lines = 24;
+    settings->term_cols = 80;
+    settings->latency_target = 0.040;
+    settings->export_format = EXPORT_PNG;
+    settings->export_every = 1;
+    settings->density = 0.5;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-2") == 0) settings->use_two_cells_per_block = true;
         else if (strcmp(argv[i], "-nc") == 0) settings->use_colors = false;
         else if (strcmp(argv[i], "-nh") == 0) settings->show_history = false;
         else if (strcmp(argv[i], "-ni") == 0) settings->show_info = false;
+        else if (strcmp(argv[i], "-g") == 0) settings->use_graphics = true;
+        else if (strcmp(argv[i], "--rule") == 0 && i + 1 < argc) {
+            if (!parse_rule(argv[++i], &settings->rule)) {
+                log_error("Invalid rule: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            settings->num_threads = atoi(argv[++i]);
+            settings->fixed_threads = true;
+            if (settings->num_threads < 1) {
+                log_error("Invalid thread count: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--control") == 0 && i + 1 < argc) settings->control_socket = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) settings->seed = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--density") == 0 && i + 1 < argc) {
+            settings->density = atof(argv[++i]);
+            if (settings->density < 0 || settings->density > 1) {
+                log_error("Invalid density: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--headless") == 0) settings->headless = true;
+        else if (strcmp(argv[i], "--term") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &settings->term_cols, &settings->term_lines) != 2
+                || settings->term_cols < 2 || settings->term_lines < 1) {
+                log_error("Invalid terminal size: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--generations") == 0 && i + 1 < argc) settings->max_generations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) settings->record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) settings->replay_path = argv[++i];
+        else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc) settings->timings_path = argv[++i];
+        else if (strcmp(argv[i], "--bench-render") == 0) settings->bench_render = true;
+        else if (strcmp(argv[i], "--check-hash") == 0) settings->check_hash = true;
+        else if (strcmp(argv[i], "--in-place") == 0) settings->in_place = true;
+        else if (strcmp(argv[i], "--autotune") == 0) settings->autotune = true;
+        else if (strcmp(argv[i], "--step-budget") == 0 && i + 1 < argc) {
+            settings->step_budget = atof(argv[++i]) / 1000;
+            if (settings->step_budget < 0) {
+                log_error("Invalid step budget: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--export-frames") == 0 && i + 1 < argc) settings->export_dir = argv[++i];
+        else if (strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            i++;
+            settings->count_heat = true;
+            if (strcmp(argv[i], "changes") == 0) settings->heat_mode = HEAT_CHANGES;
+            else if (strcmp(argv[i], "alive") == 0) settings->heat_mode = HEAT_ALIVE;
+            else {
+                log_error("Invalid heatmap mode: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--world") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &settings->world_width, &settings->world_height) != 2
+                || settings->world_width < 1 || settings->world_height < 1) {
+                log_error("Invalid world size: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--export-format") == 0 && i + 1 < argc) {
+            if (!parse_export_format(argv[++i], &settings->export_format) || settings->export_format == EXPORT_RAW) {
+                log_error("Invalid export format: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc) {
+            settings->export_every = atoi(argv[++i]);
+            if (settings->export_every < 1) {
+                log_error("Invalid export interval: %s", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--latency-target") == 0 && i + 1 < argc) settings->latency_target = atof(argv[++i]) / 1000;
         else if (strcmp(argv[i], "-h") == 0) {
-            printf("Usage: %s [-2] [-nc] [-nh] [-ni]\n", argv[0]);
+            printf("Usage: %s [-2] [-nc] [-nh] [-ni] [-g] [--rule RULE] [--threads N] [--control PATH] [--seed N]\n"
+                   "       [--density D] [--headless] [--term COLSxLINES] [--generations N] [--record FILE] [--replay FILE]\n"
+                   "       [--timings FILE] [--bench-render] [--latency-target MS] [--export-frames DIR]\n"
+                   "       [--export-format png|ppm] [--every N] [--heatmap changes|alive] [--world WxH] [--check-hash]\n"
+                   "       [--in-place] [--step-budget MS] [--autotune]\n", argv[0]);
             printf("Options:\n");
             printf("  -2 : Display two cells per block\n");
             printf("  -nc: No colors will be used\n");
             printf("  -nh: Do not show history\n");
             printf("  -ni: Do not show info at start\n");
+            printf("  -g : One pixel per cell with sixel graphics\n");
+            printf("  --rule RULE   : Birth/survive rule, default B3/S23\n");
+            printf("  --threads N   : Threads used to update the cells, default 1\n");
+            printf("  --control PATH: Accept commands on the unix socket PATH\n");
+            printf("  --seed N      : Seed of the random cells, default 1\n");
+            printf("  --density D   : Probability of a random cell to be alive, default 0.5\n");
+            printf("  --headless    : Run without a terminal\n");
+            printf("  --term CxL    : Terminal size in headless mode, default 80x24\n");
+            printf("  --generations N: Stop after N generations\n");
+            printf("  --record FILE : Record keys and resizes to FILE\n");
+            printf("  --replay FILE : Replay keys and resizes of FILE as fast as possible\n");
+            printf("  --timings FILE: Write the time of every frame to FILE (csv)\n");
+            printf("  --bench-render: Benchmark the rendering into a pseudo-terminal (size --term)\n");
+            printf("  --latency-target MS: Degrade the rendering above MS per frame, default 40, 0 = off\n");
+            printf("  --export-frames DIR: Export generations as images to DIR, - writes raw rgb24 to stdout\n");
+            printf("  --export-format F  : png (default) or ppm\n");
+            printf("  --every N          : Export every N-th generation, default 1\n");
+            printf("  --heatmap M        : The activity heatmap counts changes (default) or alive\n");
+            printf("  --world WxH        : Fixed world of W x H cells, default the terminal size\n");
+            printf("  --check-hash       : Compare the incremental hash with a full recompute every generation\n");
+            printf("  --in-place         : Step the cells in place, half the memory of the cells\n");
+            printf("  --step-budget MS   : Calculate at most MS per frame, a longer generation is finished in the\n");
+            printf("                       next frames while the last one is shown, default 0 = off\n");
+            printf("  --autotune         : Choose --threads and --in-place by benchmarks of the world size,\n");
+            printf("                       cached per cpu, rule and size in ~/.cache/gol/autotune.tsv\n");
             exit(0);
         }
         else {
@@ -199,67 +501,77 @@ void free_game(GameOfLife *game){
     if (game == NULL) return;
     if (game->game_window != NULL) delwin(game->game_window);
     if (game->info_box != NULL) delwin(game->info_box);
+    free_sixel_image(game->sixel);
     if (game->settings != NULL) free(game->settings);
     game->history->free_history(game->history);
-    for (int i = 0; i < game-> height; i++) 
-        free(game->cells[i]);
-    free(game->cells);
+    gol_free(game->world);
+    free(game->redraw_tiles);
+    free(game->tile_history);
     free(game);
 }
 
+/*
+ * Allocates the tile maps of the incremental drawing for the size of the world.
+ * The history starts with all tiles dirty, so no change of a color class is missed.
+ * @param game: the game to allocate the tile maps for.
+**/
+void reset_dirty_tiles(GameOfLife *game) {
+    size_t tiles = (size_t)gol_tile_rows(game->world) * game->world->change_words;
+    free(game->redraw_tiles);
+    free(game->tile_history);
+    game->redraw_tiles = calloc(tiles, 1);
+    game->tile_history = malloc(tiles * TILE_HISTORY);
+    memset(game->tile_history, 1, tiles * TILE_HISTORY);
+    game->field_valid = false;
+}
+
+/*
+ * Collects the tiles to draw again after a step: the tiles with changes and the tiles whose cells reach
+ * the age 10 or 30 now, they get the next color class (see get_cell_color_class).
+ * The slot of generation g holds the births of the step to g, stamped with g - 1 (see GolWorld.births),
+ * so these cells are 1 generation old at g and reach the age 10 at g + 9 and 30 at g + 29.
+ * @param game: the game that was stepped.
+**/
+void collect_dirty_tiles(GameOfLife *game) {
+    const GolWorld *world = game->world;
+    size_t tiles = (size_t)gol_tile_rows(world) * world->change_words;
+    long generation = world->generation;
+    memcpy(game->tile_history + generation % TILE_HISTORY * tiles, world->dirty_tiles, tiles);
+    const uint8_t *age_10 = game->tile_history + (generation + TILE_HISTORY - 9) % TILE_HISTORY * tiles;
+    const uint8_t *age_30 = game->tile_history + (generation + TILE_HISTORY - 29) % TILE_HISTORY * tiles;
+    for (size_t t = 0; t < tiles; t++)
+        game->redraw_tiles[t] |= world->dirty_tiles[t] | age_10[t] | age_30[t];
+}
+
 /*
  * Updates the cells of the game.
- * The cells will be updated according to the rules of the game of life.
+ * The cells will be updated according to the rules of the game of life. With a step budget only the
+ * rows that fit into the budget are calculated, the window keeps the last complete generation.
+ * A started generation finished by another write of the world (zoom, resize, ...) counts as the
+ * finished generation of this call, so it gets the same bookkeeping in the main loop.
  * @param game: the game to update the cells for.
+ * @return true if the next generation is complete.
 **/
-void update_cells(GameOfLife *game) {
-    if (game == NULL) return;
-
-    // create a bool array to store the old cells state
-    bool **old_cells = malloc(sizeof(bool *) * game->height);
-    for (int i = 0; i < game->height; i++) {
-        old_cells[i] = malloc(sizeof(bool) * game->width);
-        for (int j = 0; j < game->width; j++)
-            old_cells[i][j] = game->cells[i][j].alive;
+bool update_cells(GameOfLife *game) {
+    if (game == NULL) return false;
+    GolWorld *world = game->world;
+    world->rule = game->settings->rule;
+    world->num_threads = game->settings->num_threads;
+    world->heat_mode = game->settings->heat_mode;
+    world->check_hash = game->settings->check_hash;
+    world->in_place = game->settings->in_place;
+    if (world->generation != game->last_generation) {
+        game->last_generation = world->generation;
+        collect_dirty_tiles(game);
+        return true;
     }
-    //#pragma omp parallel for num_threads(16)
-    for (int i = 0; i < game->height; i++) {
-        for (int j = 0; j < game->width; j++) {
-            int alive_neighbours = 0;
-            for (int x = -1; x <= 1; x++) {
-                for (int y = -1; y <= 1; y++) {
-                    if (x == 0 && y == 0) continue;
-
-                    int new_x = i + x;
-                    int new_y = j + y;
-                    if (new_x < 0 || new_x >= game->height || new_y < 0 || new_y >= game->width)
-                        continue;
-
-                    if (old_cells[new_x][new_y])
-                        alive_neighbours++;
-                }
-            }
-            if (game->cells[i][j].alive) {
-                if (alive_neighbours < 2 || alive_neighbours > 3) {
-                    game->cells[i][j].alive = false;
-                    game->cells[i][j].alive_for_iterations = 0;
-                } else {
-                    game->cells[i][j].alive_for_iterations += 1;
-                }
-            }
-            else {
-                if (alive_neighbours == 3) {
-                    game->cells[i][j].alive = true;
-                    game->cells[i][j].alive_for_iterations += 1;
-                }
-            }
-        }
+    if (game->settings->step_budget > 0) {
+        if (!gol_step_slice(world, game->settings->step_budget)) return false;
     }
-
-    // Free the old cells array
-    for (int i = 0; i < game->height; i++)
-        free(old_cells[i]);
-    free(old_cells);
+    else gol_step(world, 1);
+    game->last_generation = world->generation;
+    collect_dirty_tiles(game);
+    return true;
 }
 
 /*
@@ -268,107 +580,439 @@ void update_cells(GameOfLife *game) {
  * @param game: the game to handle the resize for.
 **/
 void handle_resize(GameOfLife *game){
-    if (game == NULL || game->cells == NULL){
+    if (game == NULL || game->world == NULL){
         log_error("Cannot resize given GameOfLife is None or the cells are None.");
         return;
     }
     int old_height = game->height;
     int old_width = game->width;
+    int old_term_lines = game->term_lines;
+    int old_term_cols = game->term_cols;
     update_game_x_y(game);
 
+    if (game->recording != NULL && (old_term_lines != game->term_lines || old_term_cols != game->term_cols)) {
+        RecordEvent event = { .frame = game->frame, .generation = game->count_circles, .type = EVENT_RESIZE,
+                              .lines = game->term_lines, .cols = game->term_cols };
+        recording_write(game->recording, &event);
+    }
+
+    if (old_term_lines != game->term_lines || old_term_cols != game->term_cols) game->field_valid = false;
+
     // Check if the size has changed
     if (old_height == game->height && old_width == game->width)
         return;
 
     log_info("Size-update: (%dx%d)->(%dx%d)", old_height, old_width, game->height, game->width);
 
-    // Resize the array of rows
-    if (game->height > old_height) {
-        game->cells = realloc(game->cells, sizeof(Cell *) * game->height);
-        for (int i = old_height; i < game->height; i++) {
-            game->cells[i] = malloc(sizeof(Cell) * game->width);
-            for (int j = 0; j < game->width; j++) {
-                game->cells[i][j].alive = rand() % 2 == 0;
-                game->cells[i][j].alive_for_iterations = 0;
-            }
-        }
+    gol_resize(game->world, game->width, game->height);
+    reset_dirty_tiles(game);
+
+    // A smaller world has fewer levels in the pyramid
+    int max_zoom = pyramid_levels(game->width, game->height) - 1;
+    if (game->zoom > max_zoom) {
+        game->zoom = max_zoom;
+        if (game->zoom == 0) gol_enable_pyramid(game->world, false);
     }
-    else if (game->height < old_height){
-        for (int i = game->height; i < old_height; i++) {
-            free(game->cells[i]);
-        }
+
+    // New rows and then new columns get random cells
+    uint8_t *cells = gol_cells(game->world);
+    for (int i = old_height; i < game->height; i++) {
+        for (int j = 0; j < game->width; j++)
+            cells[i * game->width + j] = rand() % 2 == 0;
+    }
+    for (int i = 0; i < game->height; i++) {
+        for (int j = old_width; j < game->width; j++)
+            cells[i * game->width + j] = rand() % 2 == 0;
     }
+    gol_recount(game->world);
+}
 
-    // Resize each row
-    if (game->width > old_width) {
-        for (int i = 0; i < game->height; i++) {
-            game->cells[i] = realloc(game->cells[i], sizeof(Cell) * game->width);
-            for (int j = old_width; j < game->width; j++) {
-                game->cells[i][j].alive = rand() % 2 == 0;
-                game->cells[i][j].alive_for_iterations = 0;
-            }
+/*
+ * Returns the color class (1-4) of a cell, which is also the number of its color pair.
+ * The class depends on the number of iterations the cell is alive.
+ * @param age: the number of iterations the cell is alive.
+ * @return the color class of the cell.
+**/
+int get_cell_color_class(int age) {
+    if (age < 1) return 1;
+    else if (age < 10) return 2;
+    else if (age < 30) return 3;
+    else return 4;
+}
+
+/*
+ * Returns the color of a cell. The color depends on the number of iterations the cell is alive.
+ * @param age: the number of iterations the cell is alive.
+ * @return the color of the cell.
+**/
+int get_cell_color(int age) {
+    return COLOR_PAIR(get_cell_color_class(age));
+}
+
+/*
+ * Returns the largest heat value of the game.
+ * @param game: the game with the heat values.
+ * @return the largest heat value.
+**/
+uint16_t get_max_heat(GameOfLife *game) {
+    uint16_t max = 0;
+    size_t count = (size_t)game->width * game->height;
+    for (size_t i = 0; i < count; i++)
+        if (game->world->heat[i] > max) max = game->world->heat[i];
+    return max;
+}
+
+/*
+ * Returns the heat class (0-4) of a heat value on a logarithmic scale up to max.
+ * @param heat: the heat value.
+ * @param max: the largest heat value of the game.
+ * @return 0 for no activity, 1-4 from low to high activity.
+**/
+int get_heat_class(uint16_t heat, uint16_t max) {
+    if (heat == 0) return 0;
+    int heat_class = 1 + (int)(4 * log1p(heat) / log1p(max));
+    return heat_class > 4 ? 4 : heat_class;
+}
+
+/*
+ * Returns true if a character shows two cells on top of each other. Besides the setting of the user
+ * the render level RENDER_TWO_CELLS draws so, without changing the grid: the same cells are shown
+ * with half the lines and columns, so a character covers more of the world.
+ * @param game: the game to draw.
+**/
+bool draws_two_cells(GameOfLife *game) {
+    return game->settings->use_two_cells_per_block || game->render.level >= RENDER_TWO_CELLS;
+}
+
+/*
+ * Returns the number of cell rows and columns the terminal shows without zoom.
+ * @param game: the game with the terminal size.
+ * @param rows: the visible rows of cells.
+ * @param cols: the visible columns of cells.
+**/
+void get_view_size(GameOfLife *game, int *rows, int *cols) {
+    bool two_cells = draws_two_cells(game);
+    *rows = two_cells ? game->term_lines * 2 : game->term_lines;
+    *cols = two_cells ? game->term_cols : game->term_cols / 2;
+}
+
+/*
+ * Keeps the shown part inside the world and aligns it to the blocks of the zoom level.
+ * @param game: the game with the view.
+**/
+void clamp_view(GameOfLife *game) {
+    int rows, cols;
+    get_view_size(game, &rows, &cols);
+    int scale = 1 << game->zoom;
+    int max_y = game->height - rows * scale;
+    int max_x = game->width - cols * scale;
+    if (game->view_y > max_y) game->view_y = max_y;
+    if (game->view_x > max_x) game->view_x = max_x;
+    if (game->view_y < 0) game->view_y = 0;
+    if (game->view_x < 0) game->view_x = 0;
+    game->view_y &= ~(scale - 1);
+    game->view_x &= ~(scale - 1);
+}
+
+/*
+ * Moves the shown part by a quarter of the terminal.
+ * @param game: the game with the view.
+ * @param dy: -1 up, 1 down, 0 stay.
+ * @param dx: -1 left, 1 right, 0 stay.
+**/
+void pan_view(GameOfLife *game, int dy, int dx) {
+    int rows, cols;
+    get_view_size(game, &rows, &cols);
+    int scale = 1 << game->zoom;
+    game->view_y += dy * (rows / 4 > 0 ? rows / 4 : 1) * scale;
+    game->view_x += dx * (cols / 4 > 0 ? cols / 4 : 1) * scale;
+    clamp_view(game);
+}
+
+/*
+ * Draws the zoomed out view, a shade per block of 2^zoom x 2^zoom cells from light (few)
+ * to full (all cells alive). With two cells per block a character shows two blocks on top of each other.
+ * The counts are read from the density pyramid, so the cost only depends on the terminal size.
+ * @param game: the game to draw.
+**/
+void draw_zoomed(GameOfLife *game) {
+    static const char *shades[] = { " ", CHAR_LIGHT_SHADE, CHAR_MEDIUM_SHADE, CHAR_DARK_SHADE, CHAR_FULL_BLOCK };
+    if (game->world->pyramid == NULL) gol_enable_pyramid(game->world, true);  // kept up to date by the update
+    DensityPyramid *pyramid = game->world->pyramid;
+    int level = game->zoom < pyramid->levels ? game->zoom : pyramid->levels - 1;
+    bool two_cells = draws_two_cells(game);
+    bool use_colors = game->settings->use_colors && game->render.level < RENDER_NO_COLORS;
+    uint64_t area = (uint64_t)(two_cells ? 2 : 1) << (2 * level);
+    int rows, cols;
+    get_view_size(game, &rows, &cols);
+    if (two_cells) rows /= 2;
+    for (int i = 0; i < rows; i++) {
+        int y = (game->view_y >> level) + (two_cells ? i * 2 : i);
+        if (y >= pyramid->heights[level]) break;
+        for (int j = 0; j < cols; j++) {
+            int x = (game->view_x >> level) + j;
+            if (x >= pyramid->widths[level]) break;
+            uint64_t count = pyramid_count(pyramid, level, y, x);
+            if (two_cells) count += pyramid_count(pyramid, level, y + 1, x);
+            if (count == 0) continue;
+            int density_class = 1 + 4 * (count - 1) / area;
+
+            if (use_colors) wattron(game->game_window, COLOR_PAIR(4 + density_class));
+            if (two_cells) mvwprintw(game->game_window, i, j, "%s", shades[density_class]);
+            else mvwprintw(game->game_window, i, j * 2, "%s%s", shades[density_class], shades[density_class]);
+            if (use_colors) wattroff(game->game_window, COLOR_PAIR(4 + density_class));
         }
     }
-    else if (game->width < old_width){
-        for (int i = 0; i < game->height; i++)
-            game->cells[i] = realloc(game->cells[i], sizeof(Cell) * game->width);
+}
+
+/*
+ * Draws the activity heatmap, a shade per cell from light (low) to full (high activity).
+ * With two cells per block the higher heat of both cells is shown.
+ * @param game: the game to draw the heatmap for.
+**/
+void draw_heatmap(GameOfLife *game) {
+    static const char *shades[] = { " ", CHAR_LIGHT_SHADE, CHAR_MEDIUM_SHADE, CHAR_DARK_SHADE, CHAR_FULL_BLOCK };
+    uint16_t max = get_max_heat(game);
+    if (max == 0) return;
+    bool two_cells = draws_two_cells(game);
+    int rows, cols;
+    get_view_size(game, &rows, &cols);
+    if (rows > game->height - game->view_y) rows = game->height - game->view_y;
+    if (cols > game->width - game->view_x) cols = game->width - game->view_x;
+    int cell_rows = rows;
+    if (two_cells) rows = (rows + 1) / 2;  // the last line may only have an upper cell
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            int y = game->view_y + (two_cells ? i * 2 : i), x = game->view_x + j;
+            const uint16_t *cell_heat = game->world->heat + (size_t)y * game->width + x;
+            uint16_t heat = cell_heat[0];
+            if (two_cells && i * 2 + 1 < cell_rows && cell_heat[game->width] > heat) heat = cell_heat[game->width];
+            int heat_class = get_heat_class(heat, max);
+            if (heat_class == 0) continue;
+
+            if (game->settings->use_colors) wattron(game->game_window, COLOR_PAIR(4 + heat_class));
+            if (two_cells) mvwprintw(game->game_window, i, j, "%s", shades[heat_class]);
+            else mvwprintw(game->game_window, i, j * 2, "%s%s", shades[heat_class], shades[heat_class]);
+            if (game->settings->use_colors) wattroff(game->game_window, COLOR_PAIR(4 + heat_class));
+        }
     }
 }
 
 /*
- * Returns the color of the cell. The color depends on the number of iterations the cell is alive.
- * @param cell: the cell to get the color for.
- * @return the color of the cell.
+ * Draws the cell at index of the world at row i, column j of the game view (two characters wide).
+ * @param game: the game to draw.
+ * @param use_colors: if true, alive cells get the color of their age.
 **/
-int get_cell_color(Cell *cell) {
-    if (cell == NULL) {
-        log_error("Cell is NULL, return color 1.");
-        return COLOR_PAIR(1);
+void draw_cell(GameOfLife *game, int i, int j, size_t index, bool use_colors) {
+    if (!game->world->alive[index]) {
+        mvwprintw(game->game_window, i, j * 2, "  ");
+        return;
     }
-    if (cell->alive_for_iterations < 1) return COLOR_PAIR(1);
-    else if (cell->alive_for_iterations < 10) return COLOR_PAIR(2);
-    else if (cell->alive_for_iterations < 30) return COLOR_PAIR(3);
-    else return COLOR_PAIR(4);
+    int color_pair = use_colors ? get_cell_color(gol_age(game->world, index)) : 0;
+    if (color_pair != 0) wattron(game->game_window, color_pair);
+    mvwprintw(game->game_window, i, j * 2, "%s", ALIVE_STRING);
+    if (color_pair != 0) wattroff(game->game_window, color_pair);
 }
 
 void draw_game_field(GameOfLife *game) {
     if (game == NULL) return;
-    if (game->settings->use_two_cells_per_block == true){
+    clamp_view(game);
+    if (game->zoom > 0) {
+        draw_zoomed(game);
+        return;
+    }
+    if (game->settings->show_heatmap) {
+        draw_heatmap(game);
+        return;
+    }
+
+    // Only the part of the world in the terminal is drawn
+    int rows, cols;
+    get_view_size(game, &rows, &cols);
+    if (rows > game->height - game->view_y) rows = game->height - game->view_y;
+    if (cols > game->width - game->view_x) cols = game->width - game->view_x;
+    const uint8_t *alive = game->world->alive + (size_t)game->view_y * game->width + game->view_x;
+    if (draws_two_cells(game)){
         char *ch = " ";
-        for (int i = 0; i < game->height / 2; i++) {
-            for (int j = 0; j < game->width; j++) {
-                if (!game->cells[i * 2][j].alive && !game->cells[i * 2 + 1][j].alive)
+        for (int i = 0; i < (rows + 1) / 2; i++) {
+            const uint8_t *upper = alive + (size_t)i * 2 * game->width;
+            const uint8_t *lower = i * 2 + 1 < rows ? upper + game->width : NULL;  // NULL in an odd last line
+            for (int j = 0; j < cols; j++) {
+                bool lower_alive = lower != NULL && lower[j];
+                if (!upper[j] && !lower_alive)
                     continue;
 
                 ch = " ";
-                if (game->cells[i * 2][j].alive && game->cells[i * 2 + 1][j].alive)
+                if (upper[j] && lower_alive)
                     ch = CHAR_FULL_BLOCK;
-                else if (game->cells[i * 2][j].alive)
+                else if (upper[j])
                     ch = CHAR_UPPER_HALF;
-                else if (game->cells[i * 2 + 1][j].alive)
+                else if (lower_alive)
                     ch = CHAR_LOWER_HALF;
                 mvwprintw(game->game_window, i, j, "%s", ch);
             }
         }
     }
     else {
-        int color_pair = 0;
-        for (int i = 0; i < game->height; i++) {
-            for (int j = 0; j < game->width; j++) {
-                if (game->cells[i][j].alive){
-                    if (game->settings->use_colors) {
-                        color_pair = get_cell_color(&game->cells[i][j]);
-                        wattron(game->game_window, color_pair);
-                        mvwprintw(game->game_window, i, j * 2, "%s", ALIVE_STRING);
-                        wattroff(game->game_window, color_pair);
-                    } else
-                        mvwprintw(game->game_window, i, j * 2, "%s", ALIVE_STRING);
-                }
+        bool use_colors = game->settings->use_colors && game->render.level < RENDER_NO_COLORS;
+        for (int i = 0; i < rows; i++) {
+            size_t row = (size_t)(game->view_y + i) * game->width + game->view_x;
+            for (int j = 0; j < cols; j++) {
+                if (game->world->alive[row + j]) draw_cell(game, i, j, row + j, use_colors);
+            }
+        }
+    }
+}
+
+/*
+ * Returns true if the next frame can be drawn with draw_dirty_tiles.
+ * @param game: the game to draw.
+**/
+bool can_draw_dirty_tiles(GameOfLife *game) {
+    return game->field_valid && game->zoom == 0 && !game->settings->show_heatmap && !draws_two_cells(game);
+}
+
+/*
+ * Draws only the tiles with changes since the last frame (redraw_tiles), the rest of the game window
+ * still shows the right cells. Only for one cell per block without zoom and heatmap.
+ * @param game: the game to draw.
+**/
+void draw_dirty_tiles(GameOfLife *game) {
+    int rows, cols;
+    get_view_size(game, &rows, &cols);
+    if (rows > game->height - game->view_y) rows = game->height - game->view_y;
+    if (cols > game->width - game->view_x) cols = game->width - game->view_x;
+    int tile_columns = game->world->change_words;
+    bool use_colors = game->settings->use_colors && game->render.level < RENDER_NO_COLORS;
+    for (int ty = game->view_y / GOL_TILE_ROWS; ty * GOL_TILE_ROWS < game->view_y + rows; ty++) {
+        int first_i = ty * GOL_TILE_ROWS > game->view_y ? ty * GOL_TILE_ROWS : game->view_y;
+        int last_i = (ty + 1) * GOL_TILE_ROWS < game->view_y + rows ? (ty + 1) * GOL_TILE_ROWS : game->view_y + rows;
+        for (int tx = game->view_x / 64; tx * 64 < game->view_x + cols; tx++) {
+            if (!game->redraw_tiles[(size_t)ty * tile_columns + tx]) continue;
+            int first_j = tx * 64 > game->view_x ? tx * 64 : game->view_x;
+            int last_j = (tx + 1) * 64 < game->view_x + cols ? (tx + 1) * 64 : game->view_x + cols;
+            for (int i = first_i; i < last_i; i++) {
+                for (int j = first_j; j < last_j; j++)
+                    draw_cell(game, i - game->view_y, j - game->view_x, (size_t)i * game->width + j, use_colors);
             }
         }
     }
 }
 
+/*
+ * Writes the CELL_PALETTE index of every cell row by row into pixels, from the planes of a world.
+ * @param alive: the cells (1 = alive).
+ * @param births: the births of the cells, the ages are calculated like gol_age.
+ * @param heat: the heat of the cells, if not NULL the heat classes are written instead.
+ * @param generation: the generation of the cells.
+ * @param count: the count of the cells.
+ * @param use_colors: if true, alive cells get their color class, otherwise white.
+ * @param pixels: the output, count bytes.
+**/
+void write_palette_indices(const uint8_t *alive, const uint32_t *births, const uint16_t *heat, long generation,
+                           size_t count, bool use_colors, unsigned char *pixels) {
+    if (heat != NULL) {
+        uint16_t max = 0;
+        for (size_t i = 0; i < count; i++)
+            if (heat[i] > max) max = heat[i];
+        for (size_t i = 0; i < count; i++) {
+            int heat_class = max == 0 ? 0 : get_heat_class(heat[i], max);
+            pixels[i] = heat_class == 0 ? 0 : HEAT_PALETTE_OFFSET + heat_class;
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!alive[i]) {
+            pixels[i] = 0;
+        } else if (!use_colors) {
+            pixels[i] = 5;
+        } else {
+            uint32_t age = (uint32_t)generation - births[i];
+            pixels[i] = get_cell_color_class(age > INT32_MAX ? INT32_MAX : (int)age);
+        }
+    }
+}
+
+/*
+ * Writes the CELL_PALETTE index of every cell row by row into pixels.
+ * @param game: the game with the cells.
+ * @param pixels: the output, width * height bytes.
+ * @param use_colors: if true, alive cells get their color class, otherwise white.
+ *                    If the heatmap is shown, the heat classes are written instead.
+**/
+void fill_palette_indices(GameOfLife *game, unsigned char *pixels, bool use_colors) {
+    GolWorld *world = game->world;
+    write_palette_indices(world->alive, world->births, game->settings->show_heatmap ? world->heat : NULL,
+                          world->generation, (size_t)world->width * world->height, use_colors, pixels);
+}
+
+/*
+ * @struct ExportSource
+ * @brief The data of one exported frame, converted to palette indices by an export worker.
+ * @param snapshot: the pinned cells.
+ * @param births: a copy of the births, NULL for the heatmap.
+ * @param heat: a copy of the heat, NULL without the heatmap.
+ * @param use_colors: if true, alive cells get their color class, otherwise white.
+**/
+typedef struct {
+    GolSnapshot snapshot;
+    uint32_t *births;
+    uint16_t *heat;
+    bool use_colors;
+} ExportSource;
+
+/*
+ * Writes the palette indices of an exported frame and frees its source (a FrameFill of the exporter).
+ * @param data: the ExportSource.
+ * @param pixels: the output, width * height bytes.
+**/
+void fill_export_frame(void *data, unsigned char *pixels) {
+    ExportSource *source = data;
+    write_palette_indices(source->snapshot.cells, source->births, source->heat, source->snapshot.generation,
+                          (size_t)source->snapshot.width * source->snapshot.height, source->use_colors, pixels);
+    gol_snapshot_release(&source->snapshot);
+    free(source->births);
+    free(source->heat);
+    free(source);
+}
+
+/*
+ * Queues the current generation at the exporter. The cells are pinned by a snapshot and only the plane
+ * that later steps change in place (births or heat) is copied, the workers calculate the palette indices.
+ * @param game: the game to export.
+ * @param exporter: the exporter of the frames.
+**/
+void export_generation(GameOfLife *game, FrameExporter *exporter) {
+    GolWorld *world = game->world;
+    size_t count = (size_t)world->width * world->height;
+    ExportSource *source = calloc(1, sizeof(ExportSource));
+    source->snapshot = gol_snapshot(world);
+    source->use_colors = game->settings->use_colors;
+    if (game->settings->show_heatmap) {
+        source->heat = malloc(count * sizeof(uint16_t));
+        memcpy(source->heat, world->heat, count * sizeof(uint16_t));
+    } else if (source->use_colors) {
+        source->births = malloc(count * sizeof(uint32_t));
+        memcpy(source->births, world->births, count * sizeof(uint32_t));
+    }
+    export_frame_deferred(exporter, game->count_circles, world->width, world->height, fill_export_frame, source);
+}
+
+/*
+ * Draws the game field with sixel graphics, one pixel per cell.
+ * Only the rows from the first to the last changed band are sent to the terminal.
+ * @param game: the game to draw.
+ * @return the number of bytes written to the terminal.
+**/
+size_t draw_game_graphics(GameOfLife *game) {
+    if (game->sixel == NULL || game->sixel->width != game->width || game->sixel->height != game->height) {
+        free_sixel_image(game->sixel);
+        game->sixel = create_sixel_image(game->width, game->height);
+    }
+    fill_palette_indices(game, game->sixel->pixels, game->settings->use_colors && game->render.level < RENDER_NO_COLORS);
+    return sixel_write(stdout, game->sixel, CELL_PALETTE, CELL_PALETTE_SIZE, game->cell_height_px);
+}
+
 /*
  * Calculates the average of the given array.
  * If one of the values is 0, the function will return 0.
@@ -414,11 +1058,16 @@ void draw_info_box(GameOfLife *game) {
     mvwprintw(game->info_box, 0, 1, "[i]");
     mvwprintw(game->info_box, 1, 1, "Game of Life");
     mvwprintw(game->info_box, 2, 1, "Grid: %dx%d (%d)", game->width, game->height, game->width * game->height);
+    if (game->zoom > 0 || game->settings->world_width > 0)
+        wprintw(game->info_box, " zoom 1:%d at %d,%d", 1 << game->zoom, game->view_x, game->view_y);
     mvwprintw(game->info_box, 3, 1, "Last calculation time   : %.6f sec", game->last_calc_time);
     mvwprintw(game->info_box, 4, 1, "Average calculation time: %.6f sec", game->avg_calc_time);
-    mvwprintw(game->info_box, 5, 1, "Cicles: %d", game->count_circles);
-    mvwprintw(game->info_box, game->settings->info_box_height - 3, 1, "[q]uit [r]eset [p]ause");
-    mvwprintw(game->info_box, game->settings->info_box_height - 2, 1, "[c]olors [h]istory [2]mode");
+    mvwprintw(game->info_box, 5, 1, "Cicles: %ld changed: %ld hash: %016llx", game->count_circles, game->world->changed,
+              (unsigned long long)gol_hash(game->world));
+    if (game->settings->latency_target > 0)
+        mvwprintw(game->info_box, 6, 1, "Render level: %d (%.0f KB/s)", game->render.level, game->render.throughput / 1024);
+    mvwprintw(game->info_box, game->settings->info_box_height - 3, 1, "[q]uit [r]eset [p]ause [w]rite rle");
+    mvwprintw(game->info_box, game->settings->info_box_height - 2, 1, "[c]olors [h]istory [2]mode [a]ctivity [+-]zoom");
 
 
     if (!game->settings->show_history) return; // Do not show the history
@@ -480,14 +1129,273 @@ void draw_info_box(GameOfLife *game) {
     free(total_history);
 }
 
+/*
+ * Resets the statistics and the history of the game, the cells are kept.
+ * @param game: the game to reset the statistics for.
+**/
+void reset_statistics(GameOfLife *game) {
+    game->count_circles = 0;
+    game->last_calc_time = 0;
+    game->avg_calc_time = 0;
+    game->pending_steps = 0;
+    int old_history_size = game->history->history_size;
+    game->history->free_history(game->history);
+    game->history = create_history(old_history_size);
+    timing_reset();
+    gol_reset_heat(game->world);
+}
+
+/*
+ * Resets the game. The cells will be initialized with random values.
+ * @param game: the game to reset.
+**/
+void reset_game(GameOfLife *game) {
+    game->world->num_threads = game->settings->num_threads;
+    gol_fill_random(game->world, game->settings->density, rand());  // rand() keeps the runs of a seed the same
+    reset_statistics(game);
+}
+
+/*
+ * @struct SnapshotJob
+ * @brief A snapshot file written by the signal thread.
+ * @param snapshot: the pinned cells.
+ * @param generation: the generation of the game.
+ * @param rule: the rule of the game.
+ * @param path: the path of the file.
+**/
+typedef struct {
+    GolSnapshot snapshot;
+    long generation;
+    char rule[RULE_STRING_MAX];
+    char path[CONTROL_ARG_MAX];
+} SnapshotJob;
+
+/*
+ * Writes the cells of a snapshot job in the plaintext format (.cells), alive cells as 'O', dead cells
+ * as '.', and releases the snapshot (a ControlJob).
+ * @param data: the SnapshotJob.
+**/
+void write_snapshot_job(void *data) {
+    SnapshotJob *job = data;
+    GolSnapshot *snapshot = &job->snapshot;
+    FILE *file = fopen(job->path, "w");
+    if (file == NULL) log_error("Cannot open snapshot file %s", job->path);
+    else {
+        fprintf(file, "!Name: snapshot\n!Generation: %ld\n!Rule: %s\n", job->generation, job->rule);
+        char *line = malloc(snapshot->width + 2);
+        for (int i = 0; i < snapshot->height; i++) {
+            const uint8_t *row = snapshot->cells + (size_t)i * snapshot->width;
+            for (int j = 0; j < snapshot->width; j++)
+                line[j] = row[j] ? 'O' : '.';
+            line[snapshot->width] = '\n';
+            line[snapshot->width + 1] = '\0';
+            fputs(line, file);
+        }
+        free(line);
+        if (fclose(file) == 0) log_info("Snapshot of generation %ld written to %s", job->generation, job->path);
+        else log_error("Cannot write snapshot file %s", job->path);
+    }
+    gol_snapshot_release(snapshot);
+    free(job);
+}
+
+/*
+ * Saves the cells of the game in the plaintext format (.cells). The generation is pinned with
+ * gol_snapshot and the file is written by the signal thread, the game continues meanwhile.
+ * @param game: the game to save.
+ * @param path: the path of the file.
+**/
+void save_snapshot(GameOfLife *game, const char *path) {
+    SnapshotJob *job = malloc(sizeof(SnapshotJob));
+    job->snapshot = gol_snapshot(game->world);
+    job->generation = game->count_circles;
+    format_rule(&game->settings->rule, job->rule, sizeof(job->rule));
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    control_run_later(write_snapshot_job, job);
+}
+
+/*
+ * Saves the alive cells of the game in the run length encoded format (.rle).
+ * @param game: the game to save.
+ * @param path: the path of the file, NULL for snapshot_<time>_<generation>.rle.
+ * @return true if the file was written.
+**/
+bool save_rle(GameOfLife *game, const char *path) {
+    char name[64];
+    if (path == NULL) {
+        snprintf(name, sizeof(name), "snapshot_%ld_%ld.rle", (long)time(NULL), game->count_circles);
+        path = name;
+    }
+    game->world->rule = game->settings->rule;  // a changed rule is only copied at the next step
+    if (!rle_save(game->world, path)) return false;
+    log_info("Rle of generation %ld written to %s", game->count_circles, path);
+    return true;
+}
+
+/*
+ * Loads a pattern in the run length encoded format (.rle) into the game, the rule of the file is used.
+ * All cells are cleared and the pattern is placed in the middle, parts outside the grid are cut off.
+ * @param game: the game to load the pattern into.
+ * @param path: the path of the pattern file.
+ * @return true if the pattern was loaded.
+**/
+bool load_rle(GameOfLife *game, const char *path) {
+    RleHeader header;
+    game->world->num_threads = game->settings->num_threads;
+    if (!rle_load(game->world, path, &header)) return false;
+    if (header.has_rule) game->settings->rule = header.rule;
+    reset_statistics(game);
+    log_info("Pattern %s (%dx%d) loaded.", path, header.width, header.height);
+    return true;
+}
+
+/*
+ * Loads a pattern in the plaintext format (.cells) or, for the extension .rle, the run length encoded
+ * format into the game. All cells are cleared and the pattern is placed in the middle, parts outside
+ * the grid are cut off.
+ * @param game: the game to load the pattern into.
+ * @param path: the path of the pattern file.
+ * @return true if the pattern was loaded.
+**/
+bool load_pattern(GameOfLife *game, const char *path) {
+    size_t path_length = strlen(path);
+    if (path_length > 4 && strcmp(path + path_length - 4, ".rle") == 0) return load_rle(game, path);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        log_error("Cannot open pattern file %s", path);
+        return false;
+    }
+    // First pass: size of the pattern
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    int pattern_height = 0, pattern_width = 0;
+    while ((len = getline(&line, &line_size, file)) != -1) {
+        if (line[0] == '!') continue;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+        if (len > pattern_width) pattern_width = len;
+        pattern_height++;
+    }
+
+    gol_clear(game->world);
+    uint8_t *cells = gol_cells(game->world);
+    if (pattern_height > game->height || pattern_width > game->width)
+        log_warn("Pattern %s (%dx%d) does not fit into the grid, it will be cut off.", path, pattern_width, pattern_height);
+
+    // Second pass: set the cells
+    rewind(file);
+    int offset_i = (game->height - pattern_height) / 2;
+    int offset_j = (game->width - pattern_width) / 2;
+    int row = 0;
+    while ((len = getline(&line, &line_size, file)) != -1) {
+        if (line[0] == '!') continue;
+        int i = row++ + offset_i;
+        if (i < 0 || i >= game->height) continue;
+        for (int k = 0; k < len; k++) {
+            int j = k + offset_j;
+            if (j < 0 || j >= game->width || (line[k] != 'O' && line[k] != '*')) continue;
+            cells[i * game->width + j] = 1;
+        }
+    }
+    free(line);
+    fclose(file);
+    gol_recount(game->world);
+    reset_statistics(game);
+    log_info("Pattern %s (%dx%d) loaded.", path, pattern_width, pattern_height);
+    return true;
+}
+
+/*
+ * Applies the commands of the control socket. Called between two generations.
+ * @param game: the game to apply the commands to.
+ * @param running: the running flag. if set to false, the game will stop.
+**/
+void apply_control_commands(GameOfLife *game, bool *running) {
+    ControlCommand cmd;
+    while (control_pop(&cmd)) {
+        game->field_valid = false;  // the cells may have changed outside of a step
+        switch (cmd.type) {
+            case CMD_PAUSE:
+                game->settings->pause = true;
+                break;
+            case CMD_RESUME:
+                game->settings->pause = false;
+                break;
+            case CMD_STEP:
+                game->pending_steps += cmd.value;
+                break;
+            case CMD_RULE:
+                game->settings->rule = cmd.rule;
+                break;
+            case CMD_THREADS:
+                game->settings->num_threads = cmd.value;
+                break;
+            case CMD_SNAPSHOT:
+                save_snapshot(game, cmd.arg);
+                break;
+            case CMD_RLE:
+                save_rle(game, cmd.arg);
+                break;
+            case CMD_LOAD:
+                load_pattern(game, cmd.arg);
+                break;
+            case CMD_RESET:
+                reset_game(game);
+                break;
+            case CMD_QUIT:
+                *running = false;
+                break;
+        }
+    }
+}
+
+/*
+ * Publishes the stats of the current generation for the control socket.
+ * @param game: the game to publish the stats for.
+**/
+void publish_stats(GameOfLife *game) {
+    ControlStats stats = {
+        .generation = game->count_circles,
+        .population = game->world->population,
+        .width = game->width,
+        .height = game->height,
+        .threads = game->settings->num_threads,
+        .paused = game->settings->pause,
+        .last_calc_time = game->last_calc_time,
+        .avg_calc_time = game->avg_calc_time,
+        .rule = game->settings->rule,
+        .hash = gol_hash(game->world),
+        .memory_bytes = gol_memory_size(game->world->width, game->world->height,
+                                        game->settings->in_place && game->settings->step_budget == 0,  // slices need both buffers
+                                        game->world->heat != NULL)
+                        + (game->history->history_size + game->history->history_max_size) * sizeof(double),
+    };
+    control_publish_stats(&stats);
+}
+
 /*
  * Handles the key input. The following keys are supported:
- * - [q]uit, [p]ause, [i]nfo, [c]olors, [h]istory, [2]mode, [r]eset
+ * - [q]uit, [p]ause, [i]nfo, [c]olors, [h]istory, [2]mode, [r]eset, [w]rite rle
+ * - [+]/[-] zoom out/in, arrow keys move the shown part of the world
  * @param game: the game to handle the input for.
  * @param running: the running flag. if set to false, the game will stop.
 **/
 void handle_key_input(GameOfLife *game, bool *running) {
-    int ch = getch();
+    int ch = ERR;
+    RecordEvent event;
+    if (game->recording != NULL && game->recording->replay) {
+        if (recording_take(game->recording, game->frame, EVENT_KEY, &event)) {
+            recording_check_generation(game->recording, &event, game->count_circles);
+            ch = event.key;
+        }
+    }
+    else if (!game->settings->headless) {
+        ch = getch();
+        if (ch != ERR && ch != KEY_RESIZE && game->recording != NULL) {
+            event = (RecordEvent){ .frame = game->frame, .generation = game->count_circles, .type = EVENT_KEY, .key = ch };
+            recording_write(game->recording, &event);
+        }
+    }
     switch (ch) {
         case 'q':
             *running = false;
@@ -508,24 +1416,44 @@ void handle_key_input(GameOfLife *game, bool *running) {
         case '2':
             game->settings->use_two_cells_per_block = !game->settings->use_two_cells_per_block;
             break;
+        case 'g':
+            game->settings->use_graphics = !game->settings->use_graphics;
+            break;
+        case 'a':
+            game->settings->show_heatmap = !game->settings->show_heatmap;
+            gol_enable_heat(game->world, game->settings->show_heatmap || game->settings->count_heat);
+            break;
         case 'r':
-            for (int i = 0; i < game->height; i++) {
-                for (int j = 0; j < game->width; j++) {
-                    game->cells[i][j].alive = rand() % 2 == 0;
-                    game->cells[i][j].alive_for_iterations = 0;
-                }
-            }
-            game->count_circles = 0;
-            game->last_calc_time = 0;
-            game->avg_calc_time = 0;
-            // Reset the history
-            int old_history_size = game->history->history_size;
-            game->history->free_history(game->history);
-            game->history = create_history(old_history_size);
+            reset_game(game);
+            break;
+        case 'w':
+            save_rle(game, NULL);
+            break;
+        case '+':
+            if (game->zoom + 1 < pyramid_levels(game->width, game->height)) game->zoom++;
+            break;
+        case '-':
+            if (game->zoom > 0 && --game->zoom == 0)
+                gol_enable_pyramid(game->world, false);  // not needed without zoom, the update is faster without it
+            break;
+        case KEY_UP:
+            pan_view(game, -1, 0);
+            break;
+        case KEY_DOWN:
+            pan_view(game, 1, 0);
+            break;
+        case KEY_LEFT:
+            pan_view(game, 0, -1);
+            break;
+        case KEY_RIGHT:
+            pan_view(game, 0, 1);
             break;
         default:
             break;
     }
+    // The text of the terminal may have covered the image, send all of it again
+    if (ch != ERR) sixel_invalidate(game->sixel);
+    if (ch != ERR) game->field_valid = false;  // the view, the mode or the cells may have changed
 }
 
 /*
@@ -561,20 +1489,19 @@ GameOfLife* create_game(Settings *settings) {
     else game->settings = create_settings(0, NULL);
 
 
-    game->game_window = newwin(0, 0, 0, 0);
-    game->info_box = newwin(game->settings->info_box_height, 0, 0, 0);
+    if (!game->settings->headless) {
+        game->game_window = newwin(0, 0, 0, 0);
+        game->info_box = newwin(game->settings->info_box_height, 0, 0, 0);
+    }
 
     update_game_x_y(game);
 
-    game->cells = malloc(sizeof(Cell *) * game->height);
-    for (int i = 0; i < game->height; i++) {
-        game->cells[i] = malloc(game->width *  sizeof(Cell));
-        for (int j = 0; j < game->width; j++){
-            game->cells[i][j].alive = rand() % 2 == 0;
-            game->cells[i][j].alive_for_iterations = 0;
-        }
-    }
+    game->world = gol_create(game->width, game->height, &game->settings->rule);
+    game->world->num_threads = game->settings->num_threads;
+    gol_enable_heat(game->world, game->settings->show_heatmap || game->settings->count_heat);
+    gol_fill_random(game->world, game->settings->density, rand());
     game->history = create_history(100);
+    reset_dirty_tiles(game);
 
     // Add functions to the game
     game->update_game_x_y = update_game_x_y;
@@ -605,70 +1532,458 @@ int innit_color_pairs(){
     init_pair(2, COLOR_GREEN, COLOR_WHITE);
     init_pair(3, COLOR_BLUE, COLOR_WHITE);
     init_pair(4, COLOR_YELLOW, COLOR_WHITE);
+    // Color pairs of the heat classes
+    init_pair(5, COLOR_BLUE, COLOR_BLACK);
+    init_pair(6, COLOR_CYAN, COLOR_BLACK);
+    init_pair(7, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(8, COLOR_RED, COLOR_BLACK);
     return 1;
 }
 
+/*
+ * Opens the replay of the settings. A replay overwrites the settings with the ones of
+ * the recording, so that it starts in the same state. The in place flag of the recording
+ * is the one autotune chose, so a replay is not tuned again.
+ * @param settings: the settings of the game.
+ * @return the replay, NULL if disabled or on error.
+**/
+Recording* open_replay(Settings *settings) {
+    if (settings->replay_path == NULL) return NULL;
+    Recording *rec = recording_open(settings->replay_path);
+    if (rec == NULL) return NULL;
+    RecordHeader *h = &rec->header;
+    settings->seed = h->seed;
+    settings->density = h->density;
+    settings->term_lines = h->lines;
+    settings->term_cols = h->cols;
+    settings->use_two_cells_per_block = h->use_two_cells_per_block;
+    settings->use_colors = h->use_colors;
+    settings->show_info = h->show_info;
+    settings->show_history = h->show_history;
+    settings->world_width = h->world_width;
+    settings->world_height = h->world_height;
+    settings->step_budget = h->step_budget;
+    settings->in_place = h->in_place;
+    settings->autotune = false;
+    if (!parse_rule(h->rule, &settings->rule)) log_warn("Invalid rule %s in recording.", h->rule);
+    return rec;
+}
+
+/*
+ * Opens the recording of the settings, after autotune so that the header holds
+ * the in place flag that is used.
+ * @param settings: the settings of the game.
+ * @return the recording, NULL if disabled or on error.
+**/
+Recording* open_recording(Settings *settings) {
+    if (settings->record_path != NULL) {
+        RecordHeader header = {
+            .seed = settings->seed,
+            .density = settings->density,
+            .use_two_cells_per_block = settings->use_two_cells_per_block,
+            .use_colors = settings->use_colors,
+            .show_info = settings->show_info,
+            .show_history = settings->show_history,
+            .world_width = settings->world_width,
+            .world_height = settings->world_height,
+            .step_budget = settings->step_budget,
+            .in_place = settings->in_place,
+        };
+        if (settings->headless) {
+            header.lines = settings->term_lines;
+            header.cols = settings->term_cols;
+        }
+        else getmaxyx(stdscr, header.lines, header.cols);
+        format_rule(&settings->rule, header.rule, sizeof(header.rule));
+        return recording_create(settings->record_path, &header);
+    }
+    return NULL;
+}
+
+/*
+ * Applies a replayed resize of the current frame.
+ * In headless mode the virtual terminal is resized, otherwise the size ncurses uses.
+ * @param game: the game to apply the resize to.
+**/
+void replay_resize(GameOfLife *game) {
+    RecordEvent event;
+    if (!recording_take(game->recording, game->frame, EVENT_RESIZE, &event)) return;
+    recording_check_generation(game->recording, &event, game->count_circles);
+    if (game->settings->headless) {
+        game->settings->term_lines = event.lines;
+        game->settings->term_cols = event.cols;
+    }
+    else resize_term(event.lines, event.cols);
+}
+
+/*
+ * Writes the frame times as csv (frame,seconds).
+ * @param path: the path of the csv file.
+ * @param frame_times: the time of every frame.
+ * @param count: the number of frames.
+**/
+void write_frame_times(const char *path, double *frame_times, long count) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        log_error("Cannot open timings file %s", path);
+        return;
+    }
+    fprintf(file, "frame,seconds\n");
+    for (long i = 0; i < count; i++)
+        fprintf(file, "%ld,%.9f\n", i, frame_times[i]);
+    fclose(file);
+}
+
+/*
+ * Returns true if the current frame should be drawn, the highest render levels skip frames.
+ * @param game: the game to check.
+ * @return true if the frame should be drawn.
+**/
+bool should_draw_frame(GameOfLife *game) {
+    if (game->render.level == RENDER_SKIP_MOST) return game->frame % 4 == 0;
+    if (game->render.level == RENDER_SKIP_HALF) return game->frame % 2 == 0;
+    return true;
+}
+
+/*
+ * Changes the render level. Only the drawing changes (see draws_two_cells), never the grid.
+ * @param game: the game to change the render level for.
+ * @param level: the new render level.
+**/
+void set_render_level(GameOfLife *game, RenderLevel level) {
+    AdaptiveRender *r = &game->render;
+    log_info("Render level %d -> %d (render time %.6f sec, %.0f bytes/sec)", r->level, level, r->avg_time, r->throughput);
+    r->level = level;
+    game->field_valid = false;
+    r->avg_time = 0;  // measure the new level from scratch
+    r->frames_over = 0;
+    r->frames_under = 0;
+}
+
+/*
+ * Adapts the render level to the measured render time and bandwidth of the terminal.
+ * The level is lowered if the render time stays over the latency target and raised again
+ * if the bytes of the higher level would be sent within the target at the measured bandwidth.
+ * @param game: the game to adapt the rendering for.
+ * @param render_time: the time of the last drawn frame (draw and refresh).
+ * @param bytes: the bytes written to the terminal for the last drawn frame.
+**/
+void adapt_render_quality(GameOfLife *game, double render_time, unsigned long bytes) {
+    AdaptiveRender *r = &game->render;
+    double target = game->settings->latency_target;
+    const double alpha = 0.2;  // weight of the newest frame in the moving averages
+
+    r->avg_time = r->avg_time == 0 ? render_time : (1 - alpha) * r->avg_time + alpha * render_time;
+    r->level_bytes[r->level] = r->level_bytes[r->level] == 0 ? bytes : (1 - alpha) * r->level_bytes[r->level] + alpha * bytes;
+    if (render_time > 0 && bytes > 0) {
+        double throughput = bytes / render_time;
+        r->throughput = r->throughput == 0 ? throughput : (1 - alpha) * r->throughput + alpha * throughput;
+    }
+
+    if (r->avg_time > target) {
+        r->frames_under = 0;
+        if (++r->frames_over >= ADAPT_DEGRADE_FRAMES && r->level + 1 < RENDER_LEVEL_COUNT)
+            set_render_level(game, r->level + 1);
+        return;
+    }
+    r->frames_over = 0;
+    if (r->level == RENDER_FULL) return;
+
+    // The bytes of the higher level are unknown until it was used once, assume twice the current ones
+    double higher_bytes = r->level_bytes[r->level - 1] > 0 ? r->level_bytes[r->level - 1] : 2 * r->level_bytes[r->level];
+    bool fits = r->throughput > 0 && higher_bytes / r->throughput < 0.7 * target;
+    r->frames_under = fits ? r->frames_under + 1 : 0;
+    if (r->frames_under >= ADAPT_UPGRADE_FRAMES)
+        set_render_level(game, r->level - 1);
+}
+
+/*
+ * Reads and discards everything the benchmark writes to the pseudo-terminal,
+ * so that the terminal never blocks. Ends when the slave side is closed.
+ * @param arg: pointer to the master file descriptor.
+**/
+void *drain_pty(void *arg) {
+    int fd = *(int *)arg;
+    char buffer[1 << 16];
+    while (read(fd, buffer, sizeof(buffer)) > 0);
+    return NULL;
+}
+
+/*
+ * Benchmarks draw_game_field + wrefresh with the real ncurses output into a pseudo-terminal.
+ * For every render mode and density the bytes, write syscalls and time per frame are printed.
+ * The pty has the size of --term, the frame count is --generations (default 200).
+ * @param settings: the settings with the size and the frame count.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+**/
+int run_render_benchmark(Settings *settings) {
+    const char *mode_names[] = { "colors", "no-colors", "two-cells" };
+    const double densities[] = { 0.05, 0.2, 0.5, 0.9 };
+    int frames = settings->max_generations > 0 ? settings->max_generations : 200;
+
+    setlocale(LC_CTYPE, "");
+    printf("Render benchmark: %dx%d terminal, %d frames per case\n", settings->term_cols, settings->term_lines, frames);
+    printf("%-10s %8s %14s %14s %14s\n", "mode", "density", "bytes/frame", "writes/frame", "sec/frame");
+
+    for (int mode = 0; mode < 3; mode++) {
+        for (int d = 0; d < (int)(sizeof(densities) / sizeof(densities[0])); d++) {
+            struct winsize size = { .ws_row = settings->term_lines, .ws_col = settings->term_cols };
+            int master, slave;
+            if (openpty(&master, &slave, NULL, NULL, &size) != 0) {
+                log_error("Cannot open a pseudo-terminal.");
+                return EXIT_FAILURE;
+            }
+            pthread_t drain_thread;
+            pthread_create(&drain_thread, NULL, drain_pty, &master);
+
+            FILE *out = fdopen(slave, "w");
+            FILE *in = fdopen(dup(slave), "r");
+            SCREEN *screen = newterm(NULL, out, in);
+            set_term(screen);
+            curs_set(FALSE);
+            innit_color_pairs();
+
+            Settings *case_settings = create_settings(0, NULL);
+            case_settings->use_colors = mode == 0;
+            case_settings->use_two_cells_per_block = mode == 2;
+            case_settings->show_info = false;
+            GameOfLife *game = create_game(case_settings);
+
+            unsigned long bytes_start, writes_start, bytes_end, writes_end;
+            double render_time = 0;
+            tty_count_fd(slave);  // ncurses writes the frames to the slave side
+            tty_count_read(&bytes_start, &writes_start);
+            for (int f = 0; f < frames; f++) {
+                gol_fill_random(game->world, densities[d], rand());  // new cells every frame, so the density stays the same
+                double start = omp_get_wtime();
+                wclear(game->game_window);
+                game->draw_game_field(game);
+                wrefresh(game->game_window);
+                render_time += omp_get_wtime() - start;
+            }
+            tty_count_read(&bytes_end, &writes_end);
+            tty_count_fd(-1);
+
+            printf("%-10s %8.2f %14.1f %14.2f %14.6f\n", mode_names[mode], densities[d],
+                   (double)(bytes_end - bytes_start) / frames, (double)(writes_end - writes_start) / frames,
+                   render_time / frames);
+
+            game->free_game(game);
+            endwin();
+            delscreen(screen);
+            fclose(out);
+            fclose(in);
+            pthread_join(drain_thread, NULL);
+            close(master);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     log_info("[=============| START |=============]");
     Settings *settings = create_settings(argc, argv);
     set_log_level(LOG_DEBUG);
+    control_start_signals();  // before any other thread is started, they inherit the signal mask
+    if (settings->bench_render) {
+        int result = run_render_benchmark(settings);
+        control_stop_signals();
+        free(settings);
+        return result;
+    }
 
     if (settings->use_two_cells_per_block == true && settings->use_colors == true)
         log_error("Two cells per block cannot display colors.");
 // set_log_level_error();
-    setlocale(LC_CTYPE, "");  // Activate UTF-8 support for the terminal, must be called before initscr()
-    WINDOW *win = initscr();  // Initialize the curses library and the standard screen
-    nodelay(win, TRUE);  // Makes the getch() non-blocking, getch is used for input
-    curs_set(FALSE);  // Don't show the cursor
-    noecho();  // Don't show the input
-
-    // Start colors, if terminal does not support colors, exit the main.
-    if(!innit_color_pairs()) {
-        log_error("Terminal does not support colors, exiting program ...");
-        endwin();
+    WINDOW *win = NULL;
+    if (!settings->headless) {
+        setlocale(LC_CTYPE, "");  // Activate UTF-8 support for the terminal, must be called before initscr()
+        tty_count_fd(STDOUT_FILENO);  // the bytes of the frames for the adaptive rendering
+        win = initscr();  // Initialize the curses library and the standard screen
+        nodelay(win, TRUE);  // Makes the getch() non-blocking, getch is used for input
+        keypad(win, TRUE);  // Arrow keys to move the view
+        curs_set(FALSE);  // Don't show the cursor
+        noecho();  // Don't show the input
+
+        // Start colors, if terminal does not support colors, exit the main.
+        if(!innit_color_pairs()) {
+            log_error("Terminal does not support colors, exiting program ...");
+            endwin();
+            return EXIT_FAILURE;
+        }
+    }
+
+    Recording *recording = open_replay(settings);
+    if (settings->replay_path != NULL && recording == NULL) {
+        if (win != NULL) endwin();
+        fprintf(stderr, "Cannot open recording %s\n", settings->replay_path);
         return EXIT_FAILURE;
     }
+    bool replay = recording != NULL && recording->replay;
+    if (replay && !settings->headless) resize_term(settings->term_lines, settings->term_cols);
+    srand(settings->seed);
+
+    FrameExporter *exporter = NULL;
+    if (settings->export_dir != NULL) {
+        bool raw = strcmp(settings->export_dir, "-") == 0;
+        if (raw && !settings->headless) {
+            if (win != NULL) endwin();
+            fprintf(stderr, "Raw frames to stdout need --headless\n");
+            return EXIT_FAILURE;
+        }
+        int workers = sysconf(_SC_NPROCESSORS_ONLN);
+        exporter = create_frame_exporter(settings->export_dir, raw ? EXPORT_RAW : settings->export_format,
+                                         workers, 2 * workers + 2, CELL_PALETTE, CELL_PALETTE_SIZE);
+        if (exporter == NULL) {
+            if (win != NULL) endwin();
+            fprintf(stderr, "Cannot export frames to %s\n", settings->export_dir);
+            return EXIT_FAILURE;
+        }
+    }
 
     GameOfLife *game = create_game(settings);
+    game->recording = recording;
+    // Only what the user did not set is tuned, sliced steps always use both buffers
+    TuneOptions tune_options = { .num_threads = settings->fixed_threads ? settings->num_threads : 0,
+                                 .in_place = settings->step_budget > 0 ? 0 : settings->in_place ? 1 : -1 };
+    TuneResult tune;
+    if (settings->autotune && (tune_options.num_threads == 0 || tune_options.in_place < 0)
+        && autotune(game->world->width, game->world->height, &settings->rule, &tune_options, &tune)) {
+        settings->num_threads = tune.num_threads;
+        settings->in_place = tune.in_place;
+    }
+    if (!replay) recording = game->recording = open_recording(settings);
+    if (settings->record_path != NULL && !replay && recording == NULL) {
+        game->free_game(game);
+        if (win != NULL) endwin();
+        fprintf(stderr, "Cannot open recording %s\n", settings->record_path);
+        return EXIT_FAILURE;
+    }
+    if (settings->control_socket != NULL && !control_start(settings->control_socket)) {
+        game->free_game(game);
+        if (win != NULL) endwin();
+        fprintf(stderr, "Cannot listen on control socket %s\n", settings->control_socket);
+        return EXIT_FAILURE;
+    }
+
+    // The frame times are kept for the replay report and the timings file
+    bool keep_frame_times = replay || settings->timings_path != NULL;
+    long frame_times_size = keep_frame_times ? 1024 : 0;
+    double *frame_times = keep_frame_times ? malloc(frame_times_size * sizeof(double)) : NULL;
+
     double start_time = 0;
+    double phase_start = 0;
     //for (int i = 0; i < 10; i++) {
     bool running = true;
     while (running) {
         start_time = omp_get_wtime();
 
-        game->handle_resize(game); //resize the cells array if the screen size or mode has changed
+        apply_control_commands(game, &running);  // commands of the control socket, applied between generations
+        phase_start = omp_get_wtime();
+        timing_record(PHASE_COMMANDS, phase_start - start_time);
 
-        // Update cells if game is not paused
-        if (!game->settings->pause)
-            game->update_cells(game);
+        if (replay) replay_resize(game);
+        game->handle_resize(game); //resize the cells array if the screen size or mode has changed
+        timing_record(PHASE_RESIZE, omp_get_wtime() - phase_start);
+
+        // Update cells if game is not paused or single steps are requested
+        bool step = !game->settings->pause || game->pending_steps > 0;
+        bool stepped = false;  // false while a sliced generation is not finished
+        if (step) {
+            phase_start = omp_get_wtime();
+            stepped = game->update_cells(game);
+            if (stepped && game->pending_steps > 0) game->pending_steps--;
+            timing_record(PHASE_UPDATE, omp_get_wtime() - phase_start);
+        }
 
-        // Draw the game field
-        wclear(game->game_window);
-        game->draw_game_field(game);
-        wrefresh(game->game_window);
+        if (!settings->headless && should_draw_frame(game)) {
+            unsigned long bytes_start = 0, bytes_end = 0, writes;
+            size_t image_bytes = 0;  // the image goes through stdio, which is not counted by tty_count
+            double render_start = omp_get_wtime();
+            tty_count_read(&bytes_start, &writes);
 
+            // Draw the game field
+            phase_start = omp_get_wtime();
+            if (game->settings->use_graphics) image_bytes = draw_game_graphics(game);
+            else {
+                if (can_draw_dirty_tiles(game)) draw_dirty_tiles(game);
+                else {
+                    wclear(game->game_window);
+                    game->draw_game_field(game);
+                    game->field_valid = true;
+                }
+                memset(game->redraw_tiles, 0, (size_t)gol_tile_rows(game->world) * game->world->change_words);
+                wrefresh(game->game_window);
+            }
+            timing_record(PHASE_DRAW, omp_get_wtime() - phase_start);
+
+
+            // Draw the info box
+            if (game->settings->show_info) {
+                phase_start = omp_get_wtime();
+                // wclear would clear the whole terminal at the refresh, including the image
+                if (game->settings->use_graphics) werase(game->info_box);
+                else wclear(game->info_box);
+                game->draw_info_box(game);
+                wrefresh(game->info_box);
+                timing_record(PHASE_INFO, omp_get_wtime() - phase_start);
+            }
 
-        // Draw the info box
-        if (game->settings->show_info) {
-            wclear(game->info_box);
-            game->draw_info_box(game);
-            wrefresh(game->info_box);
+            if (settings->latency_target > 0) {
+                tty_count_read(&bytes_end, &writes);
+                adapt_render_quality(game, omp_get_wtime() - render_start, bytes_end - bytes_start + image_bytes);
+            }
         }
 
         // Update the last calculation time
         game->last_calc_time = omp_get_wtime() - start_time;
-        if (!game->settings->pause) {
+        if (stepped) {
             game->update_history(game);
             game->count_circles++;
             game->avg_calc_time = (game->avg_calc_time * (game->count_circles - 1) + game->last_calc_time) / game->count_circles;
+
+            // The workers convert, encode and write the frame
+            if (exporter != NULL && game->count_circles % settings->export_every == 0)
+                export_generation(game, exporter);
+        }
+        publish_stats(game);
+        if (keep_frame_times) {
+            if (game->frame == frame_times_size) {
+                frame_times_size *= 2;
+                frame_times = realloc(frame_times, frame_times_size * sizeof(double));
+            }
+            frame_times[game->frame] = game->last_calc_time;
         }
 
         game->handle_key_input(game, &running);
-        
-        usleep(DELAY); // wait for a fixed interval
+        game->frame++;
+        if (replay && recording_finished(recording, game->frame)) running = false;
+        if (settings->max_generations > 0 && game->count_circles >= settings->max_generations) running = false;
+
+        if (!replay && !settings->headless)
+            usleep(DELAY); // wait for a fixed interval
     }
+    control_stop();
+    control_stop_signals();
+    // The end event holds the generation the recording stopped at
+    if (replay && recording->has_next && recording->next.type == EVENT_END)
+        recording_check_generation(recording, &recording->next, game->count_circles);
+    long mismatches = replay ? recording->mismatches : 0;
+    recording_close(recording, game->frame, game->count_circles);
+    free_frame_exporter(exporter);
+    long frame_count = game->frame;
+    char *timings_path = settings->timings_path;  // the settings are freed with the game
     game->free_game(game);
-    delwin(win);
-    endwin();
+    if (win != NULL) {
+        delwin(win);
+        endwin();
+    }
+
+    if (timings_path != NULL) write_frame_times(timings_path, frame_times, frame_count);
+    if (replay) {
+        print_frame_time_report(stdout, frame_times, frame_count);
+        printf("diverged: %ld events at another generation than recorded\n", mismatches);
+    }
+    free(frame_times);
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
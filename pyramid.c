@@ -0,0 +1,93 @@
+#include "pyramid.h"
+
+#include <stdlib.h>
+
+int pyramid_levels(int width, int height) {
+    int levels = 1;
+    while ((width - 1) >> (levels - 1) > 0 || (height - 1) >> (levels - 1) > 0) levels++;
+    return levels;
+}
+
+DensityPyramid *create_density_pyramid(int width, int height) {
+    DensityPyramid *pyramid = calloc(1, sizeof(DensityPyramid));
+    int levels = pyramid_levels(width, height);
+
+    pyramid->levels = levels;
+    pyramid->widths = calloc(levels, sizeof(int));
+    pyramid->heights = calloc(levels, sizeof(int));
+    pyramid->counts = calloc(levels, sizeof(uint32_t *));
+    pyramid->dirty_rows = calloc(levels, sizeof(uint8_t *));
+    for (int k = 0; k < levels; k++) {
+        pyramid->widths[k] = ((width - 1) >> k) + 1;
+        pyramid->heights[k] = ((height - 1) >> k) + 1;
+        if (k == 0) continue;  // level 0 are the cells
+        pyramid->counts[k] = calloc((size_t)pyramid->widths[k] * pyramid->heights[k], sizeof(uint32_t));
+        pyramid->dirty_rows[k] = calloc(pyramid->heights[k], 1);
+    }
+    return pyramid;
+}
+
+void free_density_pyramid(DensityPyramid *pyramid) {
+    if (pyramid == NULL) return;
+    for (int k = 1; k < pyramid->levels; k++) {
+        free(pyramid->counts[k]);
+        free(pyramid->dirty_rows[k]);
+    }
+    free(pyramid->widths);
+    free(pyramid->heights);
+    free(pyramid->counts);
+    free(pyramid->dirty_rows);
+    free(pyramid);
+}
+
+void pyramid_add_row(DensityPyramid *pyramid, int y, int32_t *deltas, bool shared) {
+    int width = pyramid->widths[1];
+    uint32_t *counts = pyramid->counts[1] + (size_t)y * width;
+    bool changed = false;
+    for (int first = 0; first < width; first += PYRAMID_TILE_BLOCKS) {
+        int last = first + PYRAMID_TILE_BLOCKS < width ? first + PYRAMID_TILE_BLOCKS : width;
+        int32_t any = 0;
+        for (int x = first; x < last; x++) any |= deltas[x];
+        if (any == 0) continue;
+        changed = true;
+        if (shared) {
+            for (int x = first; x < last; x++)
+                if (deltas[x] != 0) __atomic_fetch_add(&counts[x], deltas[x], __ATOMIC_RELAXED);
+        }
+        else {
+            for (int x = first; x < last; x++) counts[x] += deltas[x];
+        }
+        for (int x = first; x < last; x++) deltas[x] = 0;
+    }
+    if (changed) __atomic_store_n(&pyramid->dirty_rows[1][y], 1, __ATOMIC_RELAXED);
+}
+
+void pyramid_propagate(DensityPyramid *pyramid) {
+    for (int k = 1; k + 1 < pyramid->levels; k++) {
+        int child_width = pyramid->widths[k];
+        int child_height = pyramid->heights[k];
+        uint8_t *dirty = pyramid->dirty_rows[k];
+        for (int y = 0; y < pyramid->heights[k + 1]; y++) {
+            int child_y = y * 2;
+            bool second_row = child_y + 1 < child_height;
+            if (!dirty[child_y] && !(second_row && dirty[child_y + 1])) continue;
+            dirty[child_y] = 0;
+            if (second_row) dirty[child_y + 1] = 0;
+
+            // Sum the 2x2 children of every block of the row
+            const uint32_t *top = pyramid->counts[k] + (size_t)child_y * child_width;
+            const uint32_t *bottom = second_row ? top + child_width : NULL;
+            uint32_t *parent = pyramid->counts[k + 1] + (size_t)y * pyramid->widths[k + 1];
+            for (int x = 0; x < pyramid->widths[k + 1]; x++) {
+                int child_x = x * 2;
+                bool second_col = child_x + 1 < child_width;
+                uint32_t sum = top[child_x] + (second_col ? top[child_x + 1] : 0);
+                if (bottom != NULL) sum += bottom[child_x] + (second_col ? bottom[child_x + 1] : 0);
+                parent[x] = sum;
+            }
+            pyramid->dirty_rows[k + 1][y] = 1;
+        }
+    }
+    // The last level has nothing to propagate to
+    if (pyramid->levels > 1) pyramid->dirty_rows[pyramid->levels - 1][0] = 0;
+}
@@ -0,0 +1,61 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PYRAMID_TILE_BLOCKS 32  // the blocks of level 1 in a tile of 64 columns
+
+/*
+ * @struct DensityPyramid
+ * @brief Population counts of the grid at every power of two block size (like a mipmap).
+ *        Level k counts the alive cells of the 2^k x 2^k block, level 0 are the cells themselves
+ *        and not stored. The update adds the changes of level 1 with pyramid_add or pyramid_add_row, rows
+ *        with changes are marked dirty and only these are summed up to the higher levels by pyramid_propagate.
+ * @param levels: the number of levels including level 0, the last level is a single block.
+ * @param widths: the width of every level.
+ * @param heights: the height of every level.
+ * @param counts: the counts of every level (index 0 is unused), row by row.
+ * @param dirty_rows: the rows of every level that changed since the last propagation.
+**/
+typedef struct {
+    int levels;
+    int *widths;
+    int *heights;
+    uint32_t **counts;
+    uint8_t **dirty_rows;
+} DensityPyramid;
+
+/* Returns the number of levels of a pyramid for width x height cells, the last level is a single block. */
+int pyramid_levels(int width, int height);
+/* Creates an empty pyramid (all counts 0) for a grid of width x height cells. */
+DensityPyramid *create_density_pyramid(int width, int height);
+/* Frees the pyramid. */
+void free_density_pyramid(DensityPyramid *pyramid);
+/* Propagates the dirty rows of level 1 up to the single block of the last level. */
+void pyramid_propagate(DensityPyramid *pyramid);
+
+/*
+ * Adds delta (+1 birth, -1 death) for the cell at row i, column j.
+ * Safe to call from several threads at the same time.
+**/
+static inline void pyramid_add(DensityPyramid *pyramid, int i, int j, int delta) {
+    if (pyramid->levels < 2) return;
+    __atomic_fetch_add(&pyramid->counts[1][(i >> 1) * pyramid->widths[1] + (j >> 1)], delta, __ATOMIC_RELAXED);
+    __atomic_store_n(&pyramid->dirty_rows[1][i >> 1], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Adds the summed deltas of the blocks of row y of level 1 (widths[1] entries) and clears them.
+ * Only tiles of PYRAMID_TILE_BLOCKS blocks with a delta are written, the row is marked dirty once.
+ * @param shared: if true, other threads may add to the row at the same time and the adds are atomic.
+**/
+void pyramid_add_row(DensityPyramid *pyramid, int y, int32_t *deltas, bool shared);
+
+/* Returns the count of alive cells of the block at row y, column x of the level (0 outside). */
+static inline uint32_t pyramid_count(const DensityPyramid *pyramid, int level, int y, int x) {
+    if (y < 0 || x < 0 || y >= pyramid->heights[level] || x >= pyramid->widths[level]) return 0;
+    return pyramid->counts[level][y * pyramid->widths[level] + x];
+}
+
+#endif /* PYRAMID_H */
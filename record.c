@@ -0,0 +1,149 @@
+#include "record.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+
+#define RECORD_MAGIC "#gol-recording"
+
+/*
+ * Reads the next event of a replay into rec->next.
+**/
+static void read_next_event(Recording *rec) {
+    char type[16];
+    RecordEvent *e = &rec->next;
+    rec->has_next = false;
+    if (fscanf(rec->file, "%ld %ld %15s", &e->frame, &e->generation, type) != 3) return;
+
+    if (strcmp(type, "key") == 0 && fscanf(rec->file, "%d", &e->key) == 1) e->type = EVENT_KEY;
+    else if (strcmp(type, "resize") == 0 && fscanf(rec->file, "%d %d", &e->lines, &e->cols) == 2) e->type = EVENT_RESIZE;
+    else if (strcmp(type, "end") == 0) e->type = EVENT_END;
+    else {
+        log_error("Invalid event in recording at frame %ld", e->frame);
+        return;
+    }
+    rec->has_next = true;
+}
+
+Recording *recording_create(const char *path, const RecordHeader *header) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        log_error("Cannot create recording %s", path);
+        return NULL;
+    }
+    Recording *rec = calloc(1, sizeof(Recording));
+    rec->file = file;
+    rec->header = *header;
+    fprintf(file, RECORD_MAGIC " seed=%u lines=%d cols=%d two_cells=%d colors=%d info=%d history=%d rule=%s density=%g"
+            " world=%dx%d step_budget=%g in_place=%d\n",
+            header->seed, header->lines, header->cols, header->use_two_cells_per_block, header->use_colors,
+            header->show_info, header->show_history, header->rule, header->density,
+            header->world_width, header->world_height, header->step_budget, header->in_place);
+    log_info("Recording input to %s", path);
+    return rec;
+}
+
+Recording *recording_open(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        log_error("Cannot open recording %s", path);
+        return NULL;
+    }
+    Recording *rec = calloc(1, sizeof(Recording));
+    rec->file = file;
+    rec->replay = true;
+    RecordHeader *h = &rec->header;
+    int two_cells, colors, info, history;
+    if (fscanf(file, RECORD_MAGIC " seed=%u lines=%d cols=%d two_cells=%d colors=%d info=%d history=%d rule=%31s",
+               &h->seed, &h->lines, &h->cols, &two_cells, &colors, &info, &history, h->rule) != 8) {
+        log_error("Invalid header in recording %s", path);
+        fclose(file);
+        free(rec);
+        return NULL;
+    }
+    char rest[128] = "";
+    int in_place = 0;
+    if (fgets(rest, sizeof(rest), file) == NULL || sscanf(rest, " density=%lf", &h->density) != 1)
+        h->density = 0.5;  // recorded before the density was configurable
+    // Recorded before the world size, the step budget and the in place flag were in the header
+    else if (sscanf(rest, " density=%*f world=%dx%d step_budget=%lf in_place=%d",
+                    &h->world_width, &h->world_height, &h->step_budget, &in_place) != 4) {
+        h->world_width = h->world_height = 0;
+        h->step_budget = 0;
+        in_place = 0;
+    }
+    h->use_two_cells_per_block = two_cells;
+    h->use_colors = colors;
+    h->show_info = info;
+    h->show_history = history;
+    h->in_place = in_place;
+    read_next_event(rec);
+    log_info("Replaying input from %s (seed %u, %dx%d)", path, h->seed, h->cols, h->lines);
+    return rec;
+}
+
+void recording_write(Recording *rec, const RecordEvent *event) {
+    if (rec == NULL || rec->replay) return;
+    fprintf(rec->file, "%ld %ld ", event->frame, event->generation);
+    switch (event->type) {
+        case EVENT_KEY: fprintf(rec->file, "key %d\n", event->key); break;
+        case EVENT_RESIZE: fprintf(rec->file, "resize %d %d\n", event->lines, event->cols); break;
+        case EVENT_END: fprintf(rec->file, "end\n"); break;
+    }
+}
+
+bool recording_take(Recording *rec, long frame, RecordEventType type, RecordEvent *event) {
+    if (rec == NULL || !rec->replay || !rec->has_next) return false;
+    if (rec->next.frame != frame || rec->next.type != type) return false;
+    *event = rec->next;
+    read_next_event(rec);
+    return true;
+}
+
+bool recording_check_generation(Recording *rec, const RecordEvent *event, long generation) {
+    if (rec == NULL || !rec->replay || event->generation == generation) return true;
+    log_warn("Replay diverged at frame %ld: generation %ld, recorded %ld", event->frame, generation, event->generation);
+    rec->mismatches++;
+    return false;
+}
+
+bool recording_finished(Recording *rec, long frame) {
+    if (rec == NULL || !rec->replay) return false;
+    return !rec->has_next || (rec->next.type == EVENT_END && rec->next.frame <= frame);
+}
+
+void recording_close(Recording *rec, long frame, long generation) {
+    if (rec == NULL) return;
+    if (!rec->replay) {
+        RecordEvent end = { .frame = frame, .generation = generation, .type = EVENT_END };
+        recording_write(rec, &end);
+    }
+    fclose(rec->file);
+    free(rec);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void print_frame_time_report(FILE *out, double *frame_times, long count) {
+    if (count == 0) {
+        fprintf(out, "No frames.\n");
+        return;
+    }
+    double *sorted = malloc(count * sizeof(double));
+    memcpy(sorted, frame_times, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), compare_double);
+    double sum = 0;
+    for (long i = 0; i < count; i++) sum += sorted[i];
+
+    fprintf(out, "frames: %ld\n", count);
+    fprintf(out, "mean  : %.6f sec\n", sum / count);
+    fprintf(out, "p50   : %.6f sec\n", sorted[count / 2]);
+    fprintf(out, "p95   : %.6f sec\n", sorted[(long)(count * 0.95)]);
+    fprintf(out, "p99   : %.6f sec\n", sorted[(long)(count * 0.99)]);
+    fprintf(out, "max   : %.6f sec\n", sorted[count - 1]);
+    free(sorted);
+}
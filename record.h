@@ -0,0 +1,88 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef enum {
+    EVENT_KEY,
+    EVENT_RESIZE,
+    EVENT_END
+} RecordEventType;
+
+/*
+ * @struct RecordEvent
+ * @brief One recorded input event.
+ * @param frame: the frame (main loop iteration) of the event.
+ * @param generation: the generation of the game at the event.
+ * @param type: the type of the event.
+ * @param key: the key for EVENT_KEY.
+ * @param lines: the terminal lines for EVENT_RESIZE.
+ * @param cols: the terminal columns for EVENT_RESIZE.
+**/
+typedef struct {
+    long frame;
+    long generation;
+    RecordEventType type;
+    int key;
+    int lines;
+    int cols;
+} RecordEvent;
+
+/*
+ * @struct RecordHeader
+ * @brief Everything needed to start a replay in the same state as the recording.
+**/
+typedef struct {
+    unsigned int seed;
+    int lines;
+    int cols;
+    bool use_two_cells_per_block;
+    bool use_colors;
+    bool show_info;
+    bool show_history;
+    char rule[32];
+    double density;  /* the density of the random cells, 0.5 in older recordings */
+    int world_width;  /* the width of a fixed world, 0 = the size of the terminal (and in older recordings) */
+    int world_height;  /* the height of a fixed world, 0 = the size of the terminal */
+    double step_budget;  /* the max calculation time per frame in seconds, 0 = off (and in older recordings) */
+    bool in_place;  /* true if the cells were stepped in place, false in older recordings */
+} RecordHeader;
+
+/*
+ * @struct Recording
+ * @brief A recording file, opened for writing (record) or reading (replay).
+ * @param file: the recording file.
+ * @param replay: true if the file is replayed.
+ * @param header: the header of the recording.
+ * @param next: the next event to replay.
+ * @param has_next: false if there are no more events to replay.
+ * @param mismatches: the count of replayed events at another generation than recorded.
+**/
+typedef struct {
+    FILE *file;
+    bool replay;
+    RecordHeader header;
+    RecordEvent next;
+    bool has_next;
+    long mismatches;
+} Recording;
+
+/* Creates a new recording file and writes the header, returns NULL on error. */
+Recording *recording_create(const char *path, const RecordHeader *header);
+/* Opens a recording for replay and reads the header, returns NULL on error. */
+Recording *recording_open(const char *path);
+/* Appends the event to the recording. */
+void recording_write(Recording *rec, const RecordEvent *event);
+/* Takes the next replay event if it belongs to frame and has the given type. */
+bool recording_take(Recording *rec, long frame, RecordEventType type, RecordEvent *event);
+/* Compares the recorded generation of a replayed event with the replayed one, logs and counts a mismatch. */
+bool recording_check_generation(Recording *rec, const RecordEvent *event, long generation);
+/* Returns true if the replay has reached its end at frame. */
+bool recording_finished(Recording *rec, long frame);
+/* Closes the recording, a recording being written gets an end event at frame. */
+void recording_close(Recording *rec, long frame, long generation);
+/* Prints count, mean, percentiles and max of the frame times. */
+void print_frame_time_report(FILE *out, double *frame_times, long count);
+
+#endif /* RECORD_H */
@@ -0,0 +1,332 @@
+#include "rle.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+#define ALIVE_WORD 0x0101010101010101ULL  // 8 alive cells
+#define RLE_CHUNK_MIN (64 * 1024)  // min bytes of cells per chunk of the parallel parser
+#define RLE_CHUNKS_PER_THREAD 4  // more chunks than threads, the chunks take different times
+
+/*
+ * @struct RleWriter
+ * @brief The output of the runs, breaks the lines before RLE_LINE_MAX.
+ * @param file: the output file.
+ * @param line_length: the length of the current line.
+**/
+typedef struct {
+    FILE *file;
+    int line_length;
+} RleWriter;
+
+/*
+ * @struct RleChunk
+ * @brief A part of the cells of an rle file, parsed by one thread. A chunk always ends after a tag.
+ * @param start: the first character.
+ * @param end: the character after the last one.
+ * @param rows: the count of rows ended in the chunk (the counts of all '$').
+ * @param tail: the count of cells after the last '$' of the chunk (of the whole chunk without a '$').
+ * @param first_row: the row of the first cell, from the sum of rows of the chunks before.
+ * @param first_x: the column of the first cell.
+**/
+typedef struct {
+    const char *start;
+    const char *end;
+    long rows;
+    long tail;
+    long first_row;
+    long first_x;
+} RleChunk;
+
+/*
+ * Returns the end of the run of cells with the value starting at x, at most end.
+ * Checks 8 cells at once, so long runs of dead or alive cells are skipped quickly.
+**/
+static int run_end(const uint8_t *row, int x, int end, uint8_t value) {
+    uint64_t pattern = value ? ALIVE_WORD : 0;
+    uint64_t word;
+    while (x + 8 <= end) {
+        memcpy(&word, row + x, sizeof(word));
+        if (word != pattern) break;
+        x += 8;
+    }
+    while (x < end && row[x] == value) x++;
+    return x;
+}
+
+/* Returns the column after the last alive cell of the row, 0 for an empty row. */
+static int row_end(const uint8_t *row, int width) {
+    int end = width;
+    uint64_t word;
+    while (end >= 8) {
+        memcpy(&word, row + end - 8, sizeof(word));
+        if (word != 0) break;
+        end -= 8;
+    }
+    while (end > 0 && row[end - 1] == 0) end--;
+    return end;
+}
+
+/* Writes the tag repeated count times, e.g. "12o". */
+static void write_run(RleWriter *writer, long count, char tag) {
+    char run[24];
+    int length = count > 1 ? snprintf(run, sizeof(run), "%ld%c", count, tag) : snprintf(run, sizeof(run), "%c", tag);
+    if (writer->line_length + length > RLE_LINE_MAX) {
+        fputc('\n', writer->file);
+        writer->line_length = 0;
+    }
+    fputs(run, writer->file);
+    writer->line_length += length;
+}
+
+bool rle_write(const GolWorld *world, FILE *file) {
+    GolView view = gol_view(world);
+
+    // Bounding box of the alive cells
+    int min_x = view.width, max_x = 0, min_y = -1, max_y = -1;
+    for (int y = 0; y < view.height; y++) {
+        const uint8_t *row = view.cells + (size_t)y * view.width;
+        int end = row_end(row, view.width);
+        if (end == 0) continue;
+        int start = run_end(row, 0, end, 0);
+        if (min_y < 0) min_y = y;
+        max_y = y;
+        if (start < min_x) min_x = start;
+        if (end > max_x) max_x = end;
+    }
+    if (min_y < 0) min_x = max_x = min_y = max_y = 0;
+    else max_y++;
+
+    char rule[RULE_STRING_MAX];
+    format_rule(&world->rule, rule, sizeof(rule));
+    fprintf(file, "#CXRLE Pos=%d,%d Gen=%ld\n", min_x, min_y, view.generation);
+    fprintf(file, "x = %d, y = %d, rule = %s\n", max_x - min_x, max_y - min_y, rule);
+
+    RleWriter writer = { .file = file };
+    int last_y = -1;
+    for (int y = min_y; y < max_y; y++) {
+        const uint8_t *row = view.cells + (size_t)y * view.width;
+        int end = row_end(row, max_x);
+        if (end == 0) continue;  // empty rows are counted by the next '$'
+        if (last_y >= 0) write_run(&writer, y - last_y, '$');
+        last_y = y;
+        for (int x = min_x; x < end;) {
+            uint8_t value = row[x];
+            int next = run_end(row, x, end, value);
+            write_run(&writer, next - x, value ? 'o' : 'b');
+            x = next;
+        }
+    }
+    write_run(&writer, 1, '!');
+    fputc('\n', file);
+    return !ferror(file);
+}
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+ * Reads the next run (an optional count and a tag) starting at p.
+ * @return the character after the run, NULL at the end of the chunk (*tag = '!') or for an invalid run (*tag = 0).
+**/
+static const char *next_run(const char *p, const char *end, long *count, char *tag) {
+    while (p < end && is_blank(*p)) p++;
+    *tag = '!';
+    if (p == end) return NULL;
+    *tag = 0;
+    *count = 1;
+    if (isdigit((unsigned char)*p)) {
+        long n = 0;
+        while (p < end && isdigit((unsigned char)*p) && n <= INT_MAX) n = n * 10 + (*p++ - '0');
+        while (p < end && is_blank(*p)) p++;
+        if (p == end || n == 0 || n > INT_MAX) return NULL;
+        *count = n;
+    }
+    if (*p != '$' && *p != '.' && !isalpha((unsigned char)*p)) return NULL;
+    *tag = *p;
+    return p + 1;
+}
+
+/* Returns the count of the '$' at p, the digits before it (a chunk never starts inside a run). */
+static long dollar_count(const char *start, const char *p) {
+    while (p > start && is_blank(p[-1])) p--;
+    long count = 0, scale = 1;
+    while (p > start && isdigit((unsigned char)p[-1]) && scale <= INT_MAX) {
+        count += (*--p - '0') * scale;
+        scale *= 10;
+    }
+    return count > 0 ? count : 1;
+}
+
+/*
+ * First pass over a chunk: counts the rows ('$') with memchr, which checks many bytes at once, and the
+ * cells after the last '$'. Only these cells have to be parsed run by run.
+ * @return false for an invalid run.
+**/
+static bool scan_chunk(RleChunk *chunk) {
+    const char *tail = chunk->start;
+    chunk->rows = 0;
+    for (const char *p = chunk->start; (p = memchr(p, '$', chunk->end - p)) != NULL; p++) {
+        chunk->rows += dollar_count(chunk->start, p);
+        tail = p + 1;
+    }
+    chunk->tail = 0;
+    long count;
+    char tag;
+    while ((tail = next_run(tail, chunk->end, &count, &tag)) != NULL) chunk->tail += count;
+    return tag != 0;
+}
+
+/*
+ * Second pass over a chunk: sets the alive cells of the chunk, which starts at first_row, first_x of the
+ * pattern. The pattern is placed at offset_x, offset_y of the world, cells outside are cut off.
+ * @return false for an invalid run.
+**/
+static bool parse_chunk(const RleChunk *chunk, uint8_t *cells, int width, int height, long offset_x, long offset_y) {
+    long row = chunk->first_row + offset_y, x = chunk->first_x + offset_x;
+    const char *p = chunk->start;
+    long count;
+    char tag;
+    while ((p = next_run(p, chunk->end, &count, &tag)) != NULL) {
+        if (tag == '$') {
+            row += count;
+            x = offset_x;
+            continue;
+        }
+        if (tag != 'b' && tag != '.' && row >= 0 && row < height) {
+            // Every other tag is a state of a multi state rule, all of them are alive here
+            long start = x < 0 ? 0 : x, end = x + count > width ? width : x + count;
+            if (start < end) memset(cells + row * width + start, 1, end - start);
+        }
+        x += count;
+    }
+    return tag != 0;
+}
+
+/*
+ * Reads the comment lines and the header line "x = W, y = H, rule = R" starting at p.
+ * @return the first character of the cells, NULL for an invalid header.
+**/
+static const char *parse_header(const char *p, const char *end, RleHeader *header) {
+    char line[256];
+    *header = (RleHeader){ 0 };
+    while (p < end) {
+        const char *newline = memchr(p, '\n', end - p);
+        const char *next = newline != NULL ? newline + 1 : end;
+        size_t length = next - p < (long)sizeof(line) ? (size_t)(next - p) : sizeof(line) - 1;
+        memcpy(line, p, length);
+        line[length] = '\0';
+        p = next;
+        if (line[0] == '#') {
+            char *field;
+            if ((field = strstr(line, "Pos=")) != NULL) sscanf(field, "Pos=%d,%d", &header->pos_x, &header->pos_y);
+            if ((field = strstr(line, "Gen=")) != NULL) sscanf(field, "Gen=%ld", &header->generation);
+            continue;
+        }
+        if (strspn(line, " \t\r\n") == length) continue;
+        if (sscanf(line, " x = %d , y = %d", &header->width, &header->height) != 2
+            || header->width < 0 || header->height < 0) return NULL;
+        char *rule = strstr(line, "rule");
+        if (rule != NULL && (rule = strchr(rule, '=')) != NULL) {
+            rule += strspn(rule + 1, " \t") + 1;
+            rule[strcspn(rule, " \t\r\n,:")] = '\0';  // ':' starts the topology of Golly, e.g. B3/S23:T100,100
+            header->has_rule = parse_rule(rule, &header->rule);
+            if (!header->has_rule) log_warn("Unknown rule %s in the rle header, the rule is not changed.", rule);
+        }
+        return p;
+    }
+    return NULL;
+}
+
+bool rle_load(GolWorld *world, const char *path, RleHeader *header) {
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+        log_error("Cannot open rle file %s", path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    const char *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        log_error("Cannot map rle file %s", path);
+        return false;
+    }
+    const char *end = data + info.st_size;
+    RleHeader parsed;
+    const char *body = parse_header(data, end, &parsed);
+    if (body == NULL) {
+        log_error("Rle file %s has no valid header line x = W, y = H", path);
+        munmap((void *)data, info.st_size);
+        return false;
+    }
+    const char *stop = memchr(body, '!', end - body);
+    if (stop != NULL) end = stop;
+
+    // Split the cells into chunks, every chunk ends after a tag, so no run is split
+    size_t size = end - body;
+    int count = world->num_threads * RLE_CHUNKS_PER_THREAD;
+    if ((size_t)count > size / RLE_CHUNK_MIN) count = size / RLE_CHUNK_MIN;
+    if (count < 1) count = 1;
+    RleChunk *chunks = calloc(count, sizeof(RleChunk));
+    const char *start = body;
+    for (int c = 0; c < count; c++) {
+        const char *chunk_end = c + 1 < count ? body + size * (c + 1) / count : end;
+        if (chunk_end < start) chunk_end = start;
+        while (chunk_end < end && chunk_end > start && (isdigit((unsigned char)chunk_end[-1]) || is_blank(chunk_end[-1])))
+            chunk_end++;
+        chunks[c] = (RleChunk){ .start = start, .end = chunk_end };
+        start = chunk_end;
+    }
+
+    bool valid = true;
+    #pragma omp parallel for num_threads(world->num_threads) schedule(dynamic) reduction(&&:valid)
+    for (int c = 0; c < count; c++)
+        valid = scan_chunk(&chunks[c]) && valid;
+
+    // Prefix sum of the rows: the first row and column of every chunk
+    for (int c = 1; c < count; c++) {
+        chunks[c].first_row = chunks[c - 1].first_row + chunks[c - 1].rows;
+        chunks[c].first_x = chunks[c - 1].rows > 0 ? chunks[c - 1].tail : chunks[c - 1].first_x + chunks[c - 1].tail;
+    }
+
+    gol_clear(world);
+    if (parsed.width > world->width || parsed.height > world->height)
+        log_warn("Pattern %s (%dx%d) does not fit into the grid, it will be cut off.", path, parsed.width, parsed.height);
+    uint8_t *cells = gol_cells(world);
+    long offset_x = (world->width - parsed.width) / 2, offset_y = (world->height - parsed.height) / 2;
+    if (valid) {
+        #pragma omp parallel for num_threads(world->num_threads) schedule(dynamic) reduction(&&:valid)
+        for (int c = 0; c < count; c++)
+            valid = parse_chunk(&chunks[c], cells, world->width, world->height, offset_x, offset_y) && valid;
+    }
+    free(chunks);
+    munmap((void *)data, info.st_size);
+    if (!valid) {
+        log_error("Rle file %s has an invalid run", path);
+        gol_clear(world);
+        return false;
+    }
+    gol_recount(world);
+    if (header != NULL) *header = parsed;
+    return true;
+}
+
+bool rle_save(const GolWorld *world, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        log_error("Cannot open rle file %s", path);
+        return false;
+    }
+    bool ok = rle_write(world, file);
+    if (fclose(file) != 0) ok = false;
+    if (!ok) log_error("Cannot write rle file %s", path);
+    return ok;
+}
@@ -0,0 +1,57 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "gol.h"
+
+/*
+ * The run length encoded pattern format (.rle) of Golly and the LifeWiki:
+ *   #CXRLE Pos=X,Y Gen=N
+ *   x = W, y = H, rule = B3/S23
+ *   bo$2bo$3o!
+ * 'b' is a dead cell, 'o' an alive cell, '$' the end of a row and '!' the end of the pattern,
+ * a count before a tag repeats it. Dead cells at the end of a row are left out.
+**/
+
+#define RLE_LINE_MAX 70  // max length of a line of cells, as written by Golly
+
+/*
+ * @struct RleHeader
+ * @brief The header of an rle file.
+ * @param width: the width of the pattern.
+ * @param height: the height of the pattern.
+ * @param pos_x: the column of the pattern in the written world (#CXRLE Pos), 0 if not given.
+ * @param pos_y: the row of the pattern in the written world (#CXRLE Pos), 0 if not given.
+ * @param generation: the generation of the pattern (#CXRLE Gen), 0 if not given.
+ * @param has_rule: true if the file gives a rule.
+ * @param rule: the rule of the pattern, if has_rule.
+**/
+typedef struct {
+    int width;
+    int height;
+    int pos_x;
+    int pos_y;
+    long generation;
+    bool has_rule;
+    Rule rule;
+} RleHeader;
+
+/*
+ * Writes the bounding box of the alive cells of the world as rle. The Pos of the #CXRLE line is the
+ * position of the box in the world, Gen the generation of the world.
+ * @return false if the file could not be written.
+**/
+bool rle_write(const GolWorld *world, FILE *file);
+/* Writes the world as rle (see rle_write) to the file at path, returns false on error. */
+bool rle_save(const GolWorld *world, const char *path);
+/*
+ * Clears the world and loads the rle file at path into the middle of it, parts outside are cut off.
+ * The file is mapped into memory and parsed in chunks with num_threads of the world, the rule of the
+ * world is not changed. The header is written to header if not NULL.
+ * @return false if the file could not be read or is invalid, the world is then left cleared.
+**/
+bool rle_load(GolWorld *world, const char *path, RleHeader *header);
+
+#endif /* RLE_H */
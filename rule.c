@@ -0,0 +1,68 @@
+#include "rule.h"
+
+#include <ctype.h>
+#include <stdio.h>
+
+Rule default_rule() {
+    Rule rule = { .birth = 1 << 3, .survive = (1 << 2) | (1 << 3) };
+    return rule;
+}
+
+/*
+ * Parses the digits of one half of a rule string into a neighbour mask.
+ * @param str: the string, will be advanced behind the digits.
+ * @param mask: the mask to set the bits in.
+ * @return false if a neighbour count is out of range.
+**/
+static bool parse_digits(const char **str, uint16_t *mask) {
+    while (isdigit((unsigned char)**str)) {
+        int n = **str - '0';
+        if (n > 8) return false;
+        *mask |= 1 << n;
+        (*str)++;
+    }
+    return true;
+}
+
+bool parse_rule(const char *str, Rule *rule) {
+    if (str == NULL || rule == NULL) return false;
+    Rule parsed = { 0, 0 };
+    const char *p = str;
+
+    if (isdigit((unsigned char)*p) || *p == '/') {
+        // Old notation: survive/birth, e.g. 23/3
+        if (!parse_digits(&p, &parsed.survive) || *p++ != '/') return false;
+        if (!parse_digits(&p, &parsed.birth)) return false;
+    } else {
+        bool seen_birth = false, seen_survive = false;
+        while (*p != '\0') {
+            char c = toupper((unsigned char)*p++);
+            if (c == 'B' && !seen_birth) {
+                seen_birth = true;
+                if (!parse_digits(&p, &parsed.birth)) return false;
+            } else if (c == 'S' && !seen_survive) {
+                seen_survive = true;
+                if (!parse_digits(&p, &parsed.survive)) return false;
+            } else return false;
+            if (*p == '/') p++;
+        }
+        if (!seen_birth || !seen_survive) return false;
+    }
+    if (*p != '\0') return false;
+    *rule = parsed;
+    return true;
+}
+
+void format_rule(const Rule *rule, char *buffer, size_t size) {
+    char tmp[RULE_STRING_MAX];
+    int pos = 0;
+    tmp[pos++] = 'B';
+    for (int n = 0; n <= 8; n++)
+        if (rule->birth & (1 << n)) tmp[pos++] = '0' + n;
+    tmp[pos++] = '/';
+    tmp[pos++] = 'S';
+    for (int n = 0; n <= 8; n++)
+        if (rule->survive & (1 << n)) tmp[pos++] = '0' + n;
+    tmp[pos] = '\0';
+    snprintf(buffer, size, "%s", tmp);
+}
@@ -0,0 +1,28 @@
+#ifndef RULE_H
+#define RULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RULE_STRING_MAX 32
+
+/*
+ * @struct Rule
+ * @brief A life-like rule in B/S notation (e.g. B3/S23).
+ * @param birth: bit n is set if a dead cell with n alive neighbours is born.
+ * @param survive: bit n is set if an alive cell with n alive neighbours survives.
+**/
+typedef struct {
+    uint16_t birth;  /* @brief bit n is set if a dead cell with n alive neighbours is born. */
+    uint16_t survive;  /* @brief bit n is set if an alive cell with n alive neighbours survives. */
+} Rule;
+
+/* The rule of Conway's game of life: B3/S23. */
+Rule default_rule();
+/* Parses a rule like "B3/S23" or "23/3" into rule, returns false if the string is invalid. */
+bool parse_rule(const char *str, Rule *rule);
+/* Writes the rule in B/S notation into buffer. */
+void format_rule(const Rule *rule, char *buffer, size_t size);
+
+#endif /* RULE_H */
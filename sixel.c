@@ -0,0 +1,155 @@
+#include "sixel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @struct Buffer
+ * @brief A growing output buffer, the image is written with one fwrite.
+**/
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+static void buffer_reserve(Buffer *b, size_t extra) {
+    if (b->len + extra <= b->cap) return;
+    while (b->len + extra > b->cap) b->cap = b->cap == 0 ? 4096 : b->cap * 2;
+    b->data = realloc(b->data, b->cap);
+}
+
+static void buffer_append(Buffer *b, const char *str, size_t len) {
+    buffer_reserve(b, len);
+    memcpy(b->data + b->len, str, len);
+    b->len += len;
+}
+
+static void buffer_printf(Buffer *b, const char *format, int a, int c) {
+    char tmp[32];
+    int len = snprintf(tmp, sizeof(tmp), format, a, c);
+    buffer_append(b, tmp, len);
+}
+
+/*
+ * Appends a run of the same sixel character, runs longer than 3 use the repeat introducer.
+**/
+static void append_run(Buffer *b, char ch, int count) {
+    if (count > 3) {
+        char tmp[16];
+        int len = snprintf(tmp, sizeof(tmp), "!%d%c", count, ch);
+        buffer_append(b, tmp, len);
+        return;
+    }
+    buffer_reserve(b, count);
+    for (int i = 0; i < count; i++) b->data[b->len++] = ch;
+}
+
+SixelImage *create_sixel_image(int width, int height) {
+    SixelImage *image = calloc(1, sizeof(SixelImage));
+    image->width = width;
+    image->height = height;
+    image->pixels = calloc((size_t)width * height, 1);
+    image->band_hashes = calloc((height + 5) / 6, sizeof(unsigned long));
+    return image;
+}
+
+void free_sixel_image(SixelImage *image) {
+    if (image == NULL) return;
+    free(image->pixels);
+    free(image->band_hashes);
+    free(image);
+}
+
+void sixel_invalidate(SixelImage *image) {
+    if (image != NULL) image->valid = 0;
+}
+
+/*
+ * FNV-1a hash of the pixels of one band.
+**/
+static unsigned long hash_band(const SixelImage *image, int band) {
+    int y_end = (band + 1) * 6 < image->height ? (band + 1) * 6 : image->height;
+    const unsigned char *p = image->pixels + (size_t)band * 6 * image->width;
+    const unsigned char *end = image->pixels + (size_t)y_end * image->width;
+    unsigned long hash = 14695981039346656037UL;
+    for (; p < end; p++) {
+        hash ^= *p;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/*
+ * Encodes the 6 pixel rows starting at y (rows at or after y_end are left transparent).
+**/
+static void encode_band(Buffer *b, const SixelImage *image, int y, int y_end, int colors) {
+    int rows = y_end - y < 6 ? y_end - y : 6;
+    const unsigned char *base = image->pixels + (size_t)y * image->width;
+
+    int present[SIXEL_MAX_COLORS] = { 0 };
+    for (const unsigned char *p = base; p < base + (size_t)rows * image->width; p++)
+        if (*p < colors) present[*p] = 1;
+
+    for (int c = 0; c < colors; c++) {
+        if (!present[c]) continue;
+        buffer_printf(b, "#%d", c, 0);
+        char run_char = 0;
+        int run_len = 0;
+        for (int x = 0; x < image->width; x++) {
+            int bits = 0;
+            for (int k = 0; k < rows; k++)
+                if (base[(size_t)k * image->width + x] == c) bits |= 1 << k;
+            char ch = 63 + bits;
+            if (ch == run_char) run_len++;
+            else {
+                if (run_len > 0) append_run(b, run_char, run_len);
+                run_char = ch;
+                run_len = 1;
+            }
+        }
+        if (run_char != 63) append_run(b, run_char, run_len);  // a trailing empty run is not needed
+        buffer_append(b, "$", 1);
+    }
+    buffer_append(b, "-", 1);
+}
+
+size_t sixel_write(FILE *out, SixelImage *image, const unsigned char palette[][3], int colors, int cell_height) {
+    int bands = (image->height + 5) / 6;
+    int first = -1, last = -1;
+    for (int band = 0; band < bands; band++) {
+        unsigned long hash = hash_band(image, band);
+        if (!image->valid || hash != image->band_hashes[band]) {
+            if (first < 0) first = band;
+            last = band;
+        }
+        image->band_hashes[band] = hash;
+    }
+    if (first < 0) return 0;  // nothing changed
+
+    // The image can only be placed at a character row, start at the row above the first change
+    int start_row = 0;
+    if (image->valid && cell_height > 0) start_row = first * 6 / cell_height;
+    int y0 = start_row * cell_height;
+    int y1 = (last + 1) * 6 < image->height ? (last + 1) * 6 : image->height;
+    image->valid = 1;
+
+    Buffer b = { 0 };
+    buffer_printf(&b, "\0337\033[%d;%dH", start_row + 1, 1);  // save the cursor for ncurses
+    buffer_printf(&b, "\033P0;1;0q\"1;1;%d;%d", image->width, y1 - y0);  // transparent for unset pixels
+    for (int c = 0; c < colors && c < SIXEL_MAX_COLORS; c++) {
+        char tmp[48];
+        int len = snprintf(tmp, sizeof(tmp), "#%d;2;%d;%d;%d", c, palette[c][0] * 100 / 255,
+                           palette[c][1] * 100 / 255, palette[c][2] * 100 / 255);
+        buffer_append(&b, tmp, len);
+    }
+    for (int y = y0; y < y1; y += 6)
+        encode_band(&b, image, y, y1, colors < SIXEL_MAX_COLORS ? colors : SIXEL_MAX_COLORS);
+    buffer_append(&b, "\033\\\0338", 4);
+
+    fwrite(b.data, 1, b.len, out);
+    fflush(out);
+    size_t written = b.len;
+    free(b.data);
+    return written;
+}
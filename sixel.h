@@ -0,0 +1,41 @@
+#ifndef SIXEL_H
+#define SIXEL_H
+
+#include <stdio.h>
+
+#define SIXEL_MAX_COLORS 16
+
+/*
+ * @struct SixelImage
+ * @brief An indexed image sent to the terminal with the Sixel graphics protocol.
+ *        The hash of every band (6 pixel rows) of the last sent image is kept,
+ *        so that only the rows from the first to the last changed band are sent again.
+ * @param width: the width in pixels.
+ * @param height: the height in pixels.
+ * @param pixels: the palette index of every pixel, row by row.
+ * @param band_hashes: the hashes of the bands of the last sent image.
+ * @param valid: false if the terminal content is unknown and the whole image must be sent.
+**/
+typedef struct {
+    int width;
+    int height;
+    unsigned char *pixels;
+    unsigned long *band_hashes;
+    int valid;
+} SixelImage;
+
+/* Creates an image with all pixels set to palette index 0. */
+SixelImage *create_sixel_image(int width, int height);
+/* Frees the image. */
+void free_sixel_image(SixelImage *image);
+/* Forces the next write to send the whole image. */
+void sixel_invalidate(SixelImage *image);
+/*
+ * Writes the changed part of the image at the top left of the terminal.
+ * palette holds rgb values (0-255) of colors palette entries, cell_height is the height of a
+ * character cell in pixels (0 if unknown, then the whole image is sent).
+ * Returns the number of bytes written.
+**/
+size_t sixel_write(FILE *out, SixelImage *image, const unsigned char palette[][3], int colors, int cell_height);
+
+#endif /* SIXEL_H */
@@ -0,0 +1,73 @@
+#include "timing.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "logger.h"
+
+/*
+ * Histograms of the phase durations. Only the main loop writes, so relaxed atomics are enough
+ * to let the stats thread read them without tearing.
+**/
+static atomic_ulong histograms[PHASE_COUNT][TIMING_BUCKETS];
+static atomic_ulong total_ns[PHASE_COUNT];
+static atomic_ulong max_ns[PHASE_COUNT];
+
+const char *get_phase_string(Phase phase) {
+    switch (phase) {
+        case PHASE_COMMANDS: return "commands";
+        case PHASE_RESIZE: return "resize";
+        case PHASE_UPDATE: return "update";
+        case PHASE_DRAW: return "draw";
+        case PHASE_INFO: return "info";
+        default: return "unknown";
+    }
+}
+
+void timing_record(Phase phase, double seconds) {
+    unsigned long ns = seconds > 0 ? (unsigned long)(seconds * 1e9) : 0;
+    unsigned long us = ns / 1000;
+    int bucket = 0;
+    while (us > 1 && bucket < TIMING_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&histograms[phase][bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&total_ns[phase], ns, memory_order_relaxed);
+    if (ns > atomic_load_explicit(&max_ns[phase], memory_order_relaxed))
+        atomic_store_explicit(&max_ns[phase], ns, memory_order_relaxed);
+}
+
+void timing_log_histograms() {
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        unsigned long counts[TIMING_BUCKETS];
+        unsigned long count = 0;
+        for (int b = 0; b < TIMING_BUCKETS; b++) {
+            counts[b] = atomic_load_explicit(&histograms[phase][b], memory_order_relaxed);
+            count += counts[b];
+        }
+        if (count == 0) continue;
+
+        double total = atomic_load_explicit(&total_ns[phase], memory_order_relaxed) / 1e9;
+        double max = atomic_load_explicit(&max_ns[phase], memory_order_relaxed) / 1e9;
+        log_info("Phase %-8s: runs=%lu avg=%.6f sec max=%.6f sec", get_phase_string(phase), count, total / count, max);
+
+        // One line with all non-empty buckets: "<upper bound in us>:<count>"
+        char line[1024];
+        int pos = 0;
+        for (int b = 0; b < TIMING_BUCKETS && pos < (int)sizeof(line); b++) {
+            if (counts[b] == 0) continue;
+            pos += snprintf(line + pos, sizeof(line) - pos, " <%luus:%lu", 2UL << b, counts[b]);
+        }
+        log_info("Phase %-8s:%s", get_phase_string(phase), line);
+    }
+}
+
+void timing_reset() {
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        for (int b = 0; b < TIMING_BUCKETS; b++)
+            atomic_store_explicit(&histograms[phase][b], 0, memory_order_relaxed);
+        atomic_store_explicit(&total_ns[phase], 0, memory_order_relaxed);
+        atomic_store_explicit(&max_ns[phase], 0, memory_order_relaxed);
+    }
+}
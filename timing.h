@@ -0,0 +1,24 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#define TIMING_BUCKETS 24  // bucket b counts durations below 2^(b+1) microseconds
+
+typedef enum {
+    PHASE_COMMANDS,
+    PHASE_RESIZE,
+    PHASE_UPDATE,
+    PHASE_DRAW,
+    PHASE_INFO,
+    PHASE_COUNT
+} Phase;
+
+/* Returns the name of the phase. */
+const char *get_phase_string(Phase phase);
+/* Adds the duration of one run of the phase to its histogram, lock-free. */
+void timing_record(Phase phase, double seconds);
+/* Writes the histograms of all phases to the log, can be called from any thread. */
+void timing_log_histograms();
+/* Clears all histograms. */
+void timing_reset();
+
+#endif /* TIMING_H */
@@ -0,0 +1,33 @@
+#include "tty_count.h"
+
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static atomic_int counted_fd = -1;
+static atomic_ulong counted_bytes;
+static atomic_ulong counted_writes;
+
+void tty_count_fd(int fd) {
+    atomic_store(&counted_fd, fd);
+    atomic_store(&counted_bytes, 0);
+    atomic_store(&counted_writes, 0);
+}
+
+void tty_count_read(unsigned long *bytes, unsigned long *writes) {
+    *bytes = atomic_load(&counted_bytes);
+    *writes = atomic_load(&counted_writes);
+}
+
+/*
+ * Replaces write of the C library in the program, ncurses flushes its output buffer with write, and
+ * passes every call on to the write syscall. Only the calls for the counted file descriptor are counted.
+**/
+ssize_t write(int fd, const void *buffer, size_t count) {
+    ssize_t written = syscall(SYS_write, fd, buffer, count);
+    if (fd == atomic_load_explicit(&counted_fd, memory_order_relaxed) && written > 0) {
+        atomic_fetch_add_explicit(&counted_bytes, written, memory_order_relaxed);
+        atomic_fetch_add_explicit(&counted_writes, 1, memory_order_relaxed);
+    }
+    return written;
+}
@@ -0,0 +1,14 @@
+#ifndef TTY_COUNT_H
+#define TTY_COUNT_H
+
+/*
+ * Counts the bytes and the write calls to one file descriptor, e.g. the terminal that ncurses draws to.
+ * Only the writes to that descriptor are counted, not the files, logs and images of other threads.
+**/
+
+/* Sets the file descriptor to count the writes to (-1 = none) and clears the counters. */
+void tty_count_fd(int fd);
+/* Returns the bytes and the write calls to the counted file descriptor since tty_count_fd. */
+void tty_count_read(unsigned long *bytes, unsigned long *writes);
+
+#endif /* TTY_COUNT_H */